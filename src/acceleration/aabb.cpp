@@ -1,18 +1,47 @@
 #include "acceleration/aabb.hpp"
 
 bool aabb::hit(const ray& r, double t_min, double t_max) const {
+    double t_enter;
+    return hit(r, t_min, t_max, t_enter);
+}
+
+bool aabb::hit(const ray& r, double t_min, double t_max, double& t_enter) const {
+    // The ray's sign bits pick which plane is entered first on each axis,
+    // so there's no division and no swap
     for (int a = 0; a < 3; a++) {
-        auto invD = 1.0f / r.direction[a];
-        auto t0 = (min()[a] - r.origin[a]) * invD;
-        auto t1 = (max()[a] - r.origin[a]) * invD;
-        if (invD < 0.0f)
-            std::swap(t0, t1);
-        t_min = t0 > t_min ? t0 : t_min;
-        t_max = t1 < t_max ? t1 : t_max;
-        if (t_max <= t_min)
-            return false;
+        const double near_plane = r.sign[a] ? maximum[a] : minimum[a];
+        const double far_plane = r.sign[a] ? minimum[a] : maximum[a];
+        t_min = fmax(t_min, (near_plane - r.origin[a]) * r.inv_direction[a]);
+        t_max = fmin(t_max, (far_plane - r.origin[a]) * r.inv_direction[a]);
+    }
+    t_enter = t_min;
+    return t_min < t_max;
+}
+
+packet_mask aabb::hit(const ray_packet& packet, double t_min, const std::array<double, packet_size>& t_max,
+    packet_mask active, std::array<double, packet_size>& t_enter) const {
+    // One branch free loop over the lanes so the compiler turns it into SIMD.
+    // Rays in a packet can point different ways, so min/max stands in for the sign bits.
+    std::array<double, packet_size> t_exit;
+    for (int i = 0; i < packet_size; i++) {
+        double t_near = t_min;
+        double t_far = t_max[i];
+        for (int a = 0; a < 3; a++) {
+            const double t0 = (minimum[a] - packet.origin[a][i]) * packet.inv_direction[a][i];
+            const double t1 = (maximum[a] - packet.origin[a][i]) * packet.inv_direction[a][i];
+            t_near = fmax(t_near, fmin(t0, t1));
+            t_far = fmin(t_far, fmax(t0, t1));
+        }
+        t_enter[i] = t_near;
+        t_exit[i] = t_far;
+    }
+
+    packet_mask mask = 0;
+    for (int i = 0; i < packet_size; i++) {
+        mask |= packet_mask(t_enter[i] < t_exit[i]) << i;
     }
-    return true;
+
+    return mask & active;
 }
 
 aabb surrounding_box(const aabb& box0, const aabb& box1) {
@@ -1,12 +1,18 @@
 #pragma once
 
 #include "core/ray.hpp"
+#include "core/ray_packet.hpp"
 
 class aabb {
 public:
     aabb() {}
     aabb(const point3& a, const point3& b) { minimum = a; maximum = b; }
 
+    // A box that contains nothing and grows to fit whatever is added to it
+    static aabb empty() {
+        return aabb(point3(infinity, infinity, infinity), point3(-infinity, -infinity, -infinity));
+    }
+
     point3 min() const { return minimum; }
     point3 max() const { return maximum; }
 
@@ -15,8 +21,54 @@ public:
 		return 2.0 * (a.x() * a.y() + a.x() * a.z() + a.y() * a.z());
 	}
 
+    point3 center() const {
+        return 0.5 * (minimum + maximum);
+    }
+
+    // Index of the axis along which the box is widest
+    int longest_axis() const {
+        auto a = maximum - minimum;
+        if (a.x() > a.y() && a.x() > a.z()) return 0;
+        return a.y() > a.z() ? 1 : 2;
+    }
+
+    void expand(const point3& p) {
+        for (int a = 0; a < 3; a++) {
+            minimum[a] = fmin(minimum[a], p[a]);
+            maximum[a] = fmax(maximum[a], p[a]);
+        }
+    }
+
+    void expand(const aabb& box) {
+        for (int a = 0; a < 3; a++) {
+            minimum[a] = fmin(minimum[a], box.minimum[a]);
+            maximum[a] = fmax(maximum[a], box.maximum[a]);
+        }
+    }
+
+    // Shrinks the box to the part that is also inside region
+    void clip(const aabb& region) {
+        for (int a = 0; a < 3; a++) {
+            minimum[a] = fmax(minimum[a], region.minimum[a]);
+            maximum[a] = fmin(maximum[a], region.maximum[a]);
+        }
+    }
+
+    // Flat boxes, like the ones around rects, still count as holding something
+    bool is_empty() const {
+        return minimum.x() > maximum.x() || minimum.y() > maximum.y() || minimum.z() > maximum.z();
+    }
+
     bool hit(const ray& r, double t_min, double t_max) const;
 
+    // Also writes the distance at which the ray enters the box
+    bool hit(const ray& r, double t_min, double t_max, double& t_enter) const;
+
+    // Tests all rays of a packet at once. Returns the active rays that hit and
+    // writes the distance at which each ray enters the box.
+    packet_mask hit(const ray_packet& packet, double t_min, const std::array<double, packet_size>& t_max,
+        packet_mask active, std::array<double, packet_size>& t_enter) const;
+
     point3 minimum;
     point3 maximum;
 };
@@ -1,10 +1,20 @@
 #include "acceleration/bvh.hpp"
+#include "acceleration/bvh_traversal.hpp"
 
 bvh_node::bvh_node(
     std::vector<std::shared_ptr<hittable>>& objects,
     size_t start, size_t end) {
 
-    int axis = random_int(0, 2);
+    // Split along the axis the boxes spread out most along, measured on the
+    // corners the comparators sort by, so the same objects give the same tree
+    aabb corners = aabb::empty();
+    for (size_t i = start; i < end; i++) {
+        aabb object_box;
+        if (objects[i]->bounding_box(object_box)) {
+            corners.expand(object_box.min());
+        }
+    }
+    axis = corners.longest_axis();
     std::array<std::function<bool(const std::shared_ptr<hittable>&, const std::shared_ptr<hittable>&)>, 3> comparator_array = { box_x_compare, box_y_compare, box_z_compare };
     auto comparator = comparator_array[axis];
 
@@ -14,8 +24,12 @@ bvh_node::bvh_node(
         left = right = objects[start];
     }
     else if (object_span == 2) {
+        // Keep the pair in order along the axis so hit can tell which is nearer
         left = objects[start];
         right = objects[start + 1];
+        if (comparator(right, left)) {
+            std::swap(left, right);
+        }
     }
     else {
         std::sort(objects.begin() + start, objects.begin() + end, comparator);
@@ -36,14 +50,48 @@ bvh_node::bvh_node(
 
 
 bool bvh_node::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    if constexpr (enable_traversal_stats) {
+        thread_traversal_stats().box_tests++;
+    }
+
     if (!box.hit(r, t_min, t_max)) {
         return false;
     }
 
-    bool hit_left = left->hit(r, t_min, t_max, rec);
-    bool hit_right = right->hit(r, t_min, hit_left ? rec.t : t_max, rec);
+    if constexpr (enable_traversal_stats) {
+        thread_traversal_stats().nodes_visited++;
+        thread_traversal_stats().enter();
+    }
+
+    const bool hit_any = hit_children(*left, *right, axis, r, t_min, t_max, rec);
+
+    if constexpr (enable_traversal_stats) {
+        thread_traversal_stats().leave();
+    }
+
+    return hit_any;
+}
+
+packet_mask bvh_node::hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const {
+    std::array<double, packet_size> t_enter;
+    active = box.hit(packet, t_min, hits.t_max, active, t_enter);
+    if (!active) {
+        return 0;
+    }
+
+    // The right child only records hits closer than the ones the left child found
+    packet_mask hit_left = left->hit_packet(packet, t_min, hits, active);
+    packet_mask hit_right = right->hit_packet(packet, t_min, hits, active);
+
+    return hit_left | hit_right;
+}
+
+bool bvh_node::occluded(const ray& r, double t_min, double t_max) const {
+    if constexpr (enable_traversal_stats) {
+        thread_traversal_stats().box_tests++;
+    }
 
-    return hit_left || hit_right;
+    return box.hit(r, t_min, t_max) && children_occluded(*left, *right, r, t_min, t_max);
 }
 
 bool bvh_node::bounding_box(aabb& output_box) const {
@@ -7,6 +7,7 @@
 #include <functional>
 
 #include "acceleration/aabb.hpp"
+#include "acceleration/traversal_stats.hpp"
 #include "scene/hittable.hpp"
 #include "scene/hittable_list.hpp"
 #include "utils/util.hpp"
@@ -26,17 +27,27 @@ public:
         left = node.left;
         right = node.right;
         box = node.box;
+        axis = node.axis;
     }
 
     virtual bool hit(
         const ray& r, double t_min, double t_max, hit_record& rec) const override;
 
+    virtual packet_mask hit_packet(
+        const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const override;
+
     virtual bool bounding_box(aabb& output_box) const override;
 
+    virtual bool random_hit() const override { return left->random_hit() || right->random_hit(); }
+
+    virtual bool occluded(const ray& r, double t_min, double t_max) const override;
+
 public:
     std::shared_ptr<hittable> left;
     std::shared_ptr<hittable> right;
     aabb box;
+    // Axis the children were split along, right holds the larger coordinates
+    int axis = 0;
 };
 
 bvh_node create_bvh_tree(const hittable_list& list);
\ No newline at end of file
@@ -0,0 +1,617 @@
+#include "acceleration/bvh_builder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+
+#include "utils/pool.hpp"
+
+std::ostream& operator<<(std::ostream& out, const bvh_build_stats& stats) {
+    out << (stats.from_cache ? "BVH loaded from cache in " : "BVH built in ") << stats.build_ms << "ms: "
+        << stats.node_count << " nodes, " << stats.leaf_count << " leaves, depth " << stats.max_depth
+        << ", SAH cost " << stats.sah_cost;
+    if (stats.duplicates > 0) {
+        out << ", " << stats.duplicates << " duplicated references";
+    }
+    return out;
+}
+
+bvh_builder::bvh_builder(const std::vector<aabb>& primitive_bounds, const bvh_build_options& build_options,
+    const std::vector<bool>& unsplittable, clip_function clip) : options(build_options), clip(std::move(clip)) {
+    options.bin_count = std::clamp(options.bin_count, 2, max_bin_count);
+    options.max_leaf_size = std::clamp(options.max_leaf_size, 1, static_cast<int>(UINT16_MAX));
+
+    references.reserve(primitive_bounds.size());
+    for (size_t i = 0; i < primitive_bounds.size(); i++) {
+        const bool splittable = unsplittable.empty() || !unsplittable[i];
+        references.push_back({ primitive_bounds[i], primitive_bounds[i].center(), static_cast<uint32_t>(i), splittable });
+    }
+}
+
+bvh_build_stats bvh_builder::build(std::vector<linear_bvh_node>& output_nodes, std::vector<uint32_t>& output_indices, const int first_depth) {
+    auto start = std::chrono::high_resolution_clock::now();
+    root_depth = first_depth;
+
+    bvh_build_stats stats;
+    output_nodes.clear();
+
+    const int threads = options.threads > 0 ? options.threads : pool::default_thread_count();
+
+    if (options.spatial_splits && !references.empty()) {
+        build_spatial(output_nodes, output_indices, stats);
+    }
+    else if (threads > 1 && references.size() >= 2 * min_subtree_size) {
+        // Aim for several subtrees per thread so uneven subtrees still balance out
+        subtree_size = std::max(min_subtree_size, references.size() / (8 * threads));
+        build_parallel(output_nodes, threads, stats);
+    }
+    else if (!references.empty()) {
+        node_list tree;
+        tree.nodes.reserve(2 * references.size());
+
+        aabb box, centroid_box;
+        bounds_of(references, 0, references.size(), box, centroid_box);
+        build_node(tree, 0, references.size(), root_depth, box, centroid_box);
+
+        output_nodes = std::move(tree.nodes);
+        stats.leaf_count = tree.leaf_count;
+        stats.max_depth = tree.max_depth;
+    }
+
+    if (!options.spatial_splits) {
+        output_indices.resize(references.size());
+        for (size_t i = 0; i < references.size(); i++) {
+            output_indices[i] = references[i].index;
+        }
+    }
+
+    auto time = std::chrono::high_resolution_clock::now() - start;
+    stats.build_ms = std::chrono::duration<double, std::milli>(time).count();
+    stats.node_count = output_nodes.size();
+    stats.sah_cost = sah_cost(output_nodes);
+
+    return stats;
+}
+
+void bvh_builder::build_parallel(std::vector<linear_bvh_node>& output_nodes, const int threads, bvh_build_stats& stats) {
+    // Build the top of the tree here, stopping at subtrees small enough to hand off
+    node_list top;
+    subtrees.clear();
+    subtree_of_node.clear();
+    worker_threads = threads;
+    deferring = true;
+
+    aabb box, centroid_box;
+    bounds_of(references, 0, references.size(), box, centroid_box);
+    build_node(top, 0, references.size(), root_depth, box, centroid_box);
+
+    deferring = false;
+
+    // Each subtree owns a disjoint range of references so they can be built side by side
+    pool p;
+    p.num_threads = threads;
+    for (auto& task : subtrees) {
+        p.enqueue_task([this, &task]() {
+            task.result.nodes.reserve(2 * (task.end - task.start));
+            build_node(task.result, task.start, task.end, task.depth, task.box, task.centroid_box);
+        });
+    }
+    p.start_pool();
+    p.join_threads();
+
+    // Stitch everything back together in the order a serial build would produce
+    output_nodes.reserve(2 * references.size());
+    splice(top, 0, output_nodes);
+
+    stats.leaf_count = top.leaf_count;
+    stats.max_depth = top.max_depth;
+    for (const auto& task : subtrees) {
+        stats.leaf_count += task.result.leaf_count;
+        stats.max_depth = std::max(stats.max_depth, task.result.max_depth);
+    }
+
+    subtrees.clear();
+    subtree_of_node.clear();
+}
+
+void bvh_builder::splice(const node_list& top, uint32_t index, std::vector<linear_bvh_node>& output_nodes) const {
+    if (index < subtree_of_node.size() && subtree_of_node[index] >= 0) {
+        // Subtree nodes only need their child links moved to where the subtree lands
+        const auto base = static_cast<uint32_t>(output_nodes.size());
+        for (auto node : subtrees[subtree_of_node[index]].result.nodes) {
+            if (!node.is_leaf()) {
+                node.offset += base;
+            }
+            output_nodes.push_back(node);
+        }
+        return;
+    }
+
+    const size_t position = output_nodes.size();
+    output_nodes.push_back(top.nodes[index]);
+
+    if (top.nodes[index].is_leaf()) {
+        return;
+    }
+
+    splice(top, index + 1, output_nodes);
+    output_nodes[position].offset = static_cast<uint32_t>(output_nodes.size());
+    splice(top, top.nodes[index].offset, output_nodes);
+}
+
+uint32_t bvh_builder::build_node(node_list& out, size_t start, size_t end, int depth, const aabb& box, const aabb& centroid_box) {
+    const auto node_index = static_cast<uint32_t>(out.nodes.size());
+    out.nodes.emplace_back();
+    out.nodes[node_index].box = box;
+
+    const size_t object_span = end - start;
+
+    if (deferring && object_span <= subtree_size) {
+        // Leave a placeholder, the pool builds this part later
+        subtree_of_node.resize(node_index + 1, -1);
+        subtree_of_node[node_index] = static_cast<int>(subtrees.size());
+        subtrees.push_back({ start, end, depth, box, centroid_box, node_index, {} });
+        return node_index;
+    }
+
+    out.max_depth = std::max(out.max_depth, depth);
+
+    const double leaf_cost = options.intersection_cost * object_span;
+
+    split best;
+    if (object_span > 1) {
+        best = find_split(references, start, end, box, centroid_box);
+    }
+
+    // Make a leaf if splitting doesn't pay for itself and the leaf isn't too big
+    if (object_span == 1 || (object_span <= static_cast<size_t>(options.max_leaf_size) && leaf_cost <= best.cost)) {
+        out.nodes[node_index].offset = static_cast<uint32_t>(start);
+        out.nodes[node_index].count = static_cast<uint16_t>(object_span);
+        out.leaf_count++;
+        return node_index;
+    }
+
+    size_t mid = start;
+    int axis;
+    aabb left_box = aabb::empty(), left_centroids = aabb::empty();
+    aabb right_box = aabb::empty(), right_centroids = aabb::empty();
+
+    if (best.axis >= 0 && depth < bvh_max_depth / 2) {
+        axis = best.axis;
+        const auto mapping = map_bins(centroid_box, axis, best.bin_count);
+
+        // Partition and gather the bounds of both children in the same pass
+        for (size_t i = start; i < end; i++) {
+            if (mapping.index(references[i].centroid[axis]) < best.bin) {
+                left_box.expand(references[i].box);
+                left_centroids.expand(references[i].centroid);
+                std::swap(references[i], references[mid++]);
+            }
+            else {
+                right_box.expand(references[i].box);
+                right_centroids.expand(references[i].centroid);
+            }
+        }
+    }
+    else {
+        // The centroids all coincide, or the tree is getting too deep for the
+        // traversal stack, so fall back to an equal count split
+        axis = centroid_box.longest_axis();
+        mid = start + object_span / 2;
+        std::nth_element(references.begin() + start, references.begin() + mid, references.begin() + end, [&](const reference& a, const reference& b) {
+            return a.centroid[axis] < b.centroid[axis];
+        });
+        bounds_of(references, start, mid, left_box, left_centroids);
+        bounds_of(references, mid, end, right_box, right_centroids);
+    }
+
+    build_node(out, start, mid, depth + 1, left_box, left_centroids);
+    const uint32_t right = build_node(out, mid, end, depth + 1, right_box, right_centroids);
+
+    out.nodes[node_index].offset = right;
+    out.nodes[node_index].axis = static_cast<uint8_t>(axis);
+
+    return node_index;
+}
+
+void bvh_builder::build_spatial(std::vector<linear_bvh_node>& output_nodes, std::vector<uint32_t>& output_indices, bvh_build_stats& stats) {
+    // References get duplicated as the tree is built, so unlike the object
+    // split build every node owns its own list instead of a range of one array
+    node_list tree;
+    tree.nodes.reserve(2 * references.size());
+    output_indices.clear();
+    output_indices.reserve(references.size());
+
+    duplicates = 0;
+    max_duplicates = static_cast<size_t>(options.duplication_budget * references.size());
+
+    std::vector<reference> refs = references;
+    aabb box, centroid_box;
+    bounds_of(refs, 0, refs.size(), box, centroid_box);
+    root_area = box.surface_area();
+
+    build_spatial_node(tree, refs, output_indices, root_depth, box, centroid_box);
+
+    output_nodes = std::move(tree.nodes);
+    stats.leaf_count = tree.leaf_count;
+    stats.max_depth = tree.max_depth;
+    stats.duplicates = duplicates;
+}
+
+uint32_t bvh_builder::build_spatial_node(node_list& out, std::vector<reference>& refs, std::vector<uint32_t>& indices,
+    int depth, const aabb& box, const aabb& centroid_box) {
+    const auto node_index = static_cast<uint32_t>(out.nodes.size());
+    out.nodes.emplace_back();
+    out.nodes[node_index].box = box;
+    out.max_depth = std::max(out.max_depth, depth);
+
+    const size_t span = refs.size();
+    const double leaf_cost = options.intersection_cost * span;
+    // Past this depth the equal count split keeps the tree within the traversal stack
+    const bool shallow = depth < bvh_max_depth / 2;
+
+    split best;
+    spatial_split spatial;
+    if (span > 1) {
+        best = find_split(refs, 0, span, box, centroid_box);
+
+        // Only worth the extra pass where the object split leaves children that overlap
+        if (shallow && duplicates < max_duplicates
+            && (best.axis < 0 || object_split_overlap(refs, best, centroid_box) > options.spatial_split_overlap * root_area)) {
+            spatial = find_spatial_split(refs, box);
+        }
+    }
+
+    if (span == 1 || (span <= static_cast<size_t>(options.max_leaf_size) && leaf_cost <= std::min(best.cost, spatial.cost))) {
+        out.nodes[node_index].offset = static_cast<uint32_t>(indices.size());
+        out.nodes[node_index].count = static_cast<uint16_t>(span);
+        for (const auto& ref : refs) {
+            indices.push_back(ref.index);
+        }
+        out.leaf_count++;
+        return node_index;
+    }
+
+    std::vector<reference> left, right;
+    int axis = -1;
+
+    if (spatial.cost < best.cost) {
+        // References straddling the plane go to both sides, each clipped to its half
+        size_t added = 0;
+        for (const auto& ref : refs) {
+            if (ref.box.maximum[spatial.axis] <= spatial.position || (!ref.splittable && ref.centroid[spatial.axis] < spatial.position)) {
+                left.push_back(ref);
+            }
+            else if (ref.box.minimum[spatial.axis] >= spatial.position || !ref.splittable) {
+                right.push_back(ref);
+            }
+            else {
+                reference l = ref, r = ref;
+                const bool in_left = clip_reference(ref, spatial.axis, -infinity, spatial.position, l.box);
+                const bool in_right = clip_reference(ref, spatial.axis, spatial.position, infinity, r.box);
+                l.centroid = l.box.center();
+                r.centroid = r.box.center();
+
+                // The primitive itself may only reach across the plane with its box
+                if (in_left && in_right) {
+                    left.push_back(l);
+                    right.push_back(r);
+                    added++;
+                }
+                else if (in_left) {
+                    left.push_back(l);
+                }
+                else {
+                    right.push_back(in_right ? r : ref);
+                }
+            }
+        }
+
+        // Rounding at the bin edges can leave a side empty or blow the budget
+        if (!left.empty() && !right.empty() && duplicates + added <= max_duplicates) {
+            duplicates += added;
+            axis = spatial.axis;
+        }
+        else {
+            left.clear();
+            right.clear();
+        }
+    }
+
+    if (axis < 0 && best.axis >= 0 && shallow) {
+        axis = best.axis;
+        const auto mapping = map_bins(centroid_box, axis, best.bin_count);
+        for (const auto& ref : refs) {
+            (mapping.index(ref.centroid[axis]) < best.bin ? left : right).push_back(ref);
+        }
+    }
+    else if (axis < 0) {
+        axis = centroid_box.longest_axis();
+        const size_t mid = span / 2;
+        std::nth_element(refs.begin(), refs.begin() + mid, refs.end(), [&](const reference& a, const reference& b) {
+            return a.centroid[axis] < b.centroid[axis];
+        });
+        left.assign(refs.begin(), refs.begin() + mid);
+        right.assign(refs.begin() + mid, refs.end());
+    }
+
+    // This node's list isn't needed anymore, free it before going deeper
+    std::vector<reference>().swap(refs);
+
+    aabb left_box, left_centroids, right_box, right_centroids;
+    bounds_of(left, 0, left.size(), left_box, left_centroids);
+    bounds_of(right, 0, right.size(), right_box, right_centroids);
+
+    build_spatial_node(out, left, indices, depth + 1, left_box, left_centroids);
+    const uint32_t right_index = build_spatial_node(out, right, indices, depth + 1, right_box, right_centroids);
+
+    out.nodes[node_index].offset = right_index;
+    out.nodes[node_index].axis = static_cast<uint8_t>(axis);
+
+    return node_index;
+}
+
+bvh_builder::spatial_split bvh_builder::find_spatial_split(const std::vector<reference>& refs, const aabb& node_box) const {
+    const int bin_count = options.bin_count;
+
+    // Left uninitialised on purpose, only the first bin_count entries get used
+    std::array<bin, max_bin_count> bins;
+    uint32_t entries[max_bin_count];
+    uint32_t exits[max_bin_count];
+    double right_area[max_bin_count];
+    uint32_t right_count[max_bin_count];
+
+    const double inv_node_area = 1.0 / node_box.surface_area();
+    spatial_split best;
+
+    for (int axis = 0; axis < 3; axis++) {
+        const double lower = node_box.minimum[axis];
+        const double extent = node_box.maximum[axis] - lower;
+        if (extent <= 0) {
+            continue;
+        }
+
+        const bin_mapping mapping = { lower, bin_count / extent, bin_count - 1 };
+        for (int b = 0; b < bin_count; b++) {
+            bins[b].reset();
+            entries[b] = 0;
+            exits[b] = 0;
+        }
+
+        // Every reference adds the piece of its box inside each bin it crosses
+        for (const auto& ref : refs) {
+            int first = mapping.index(ref.box.minimum[axis]);
+            int last = mapping.index(ref.box.maximum[axis]);
+            if (!ref.splittable) {
+                first = last = mapping.index(ref.centroid[axis]);
+            }
+
+            if (first == last) {
+                bins[first].add(ref.box);
+            }
+            else {
+                aabb piece;
+                for (int b = first; b <= last; b++) {
+                    if (clip_reference(ref, axis, lower + b / mapping.scale, lower + (b + 1) / mapping.scale, piece)) {
+                        bins[b].add(piece);
+                    }
+                }
+            }
+            entries[first]++;
+            exits[last]++;
+        }
+
+        // Same two sweeps as the object split, counting references that enter
+        // on the left and ones that leave on the right
+        bin accumulated;
+        accumulated.reset();
+        uint32_t count = 0;
+        for (int b = bin_count - 1; b > 0; b--) {
+            accumulated.add(bins[b]);
+            count += exits[b];
+            right_area[b] = count > 0 ? accumulated.surface_area() : 0;
+            right_count[b] = count;
+        }
+
+        accumulated.reset();
+        count = 0;
+        for (int b = 1; b < bin_count; b++) {
+            accumulated.add(bins[b - 1]);
+            count += entries[b - 1];
+
+            if (count == 0 || right_count[b] == 0) {
+                continue;
+            }
+
+            double cost = options.traversal_cost + options.intersection_cost * inv_node_area
+                * (accumulated.surface_area() * count + right_area[b] * right_count[b]);
+
+            if (cost < best.cost) {
+                best.cost = cost;
+                best.axis = axis;
+                best.position = lower + b / mapping.scale;
+            }
+        }
+    }
+
+    return best;
+}
+
+bool bvh_builder::clip_reference(const reference& ref, int axis, double lower, double upper, aabb& piece) const {
+    // The reference box may already have been clipped higher up, so it stays the region
+    aabb region = ref.box;
+    region.minimum[axis] = std::max(region.minimum[axis], lower);
+    region.maximum[axis] = std::min(region.maximum[axis], upper);
+
+    if (!clip) {
+        piece = region;
+        return !piece.is_empty();
+    }
+    return clip(ref.index, region, piece);
+}
+
+double bvh_builder::object_split_overlap(const std::vector<reference>& refs, const split& best, const aabb& centroid_box) const {
+    const auto mapping = map_bins(centroid_box, best.axis, best.bin_count);
+    aabb left = aabb::empty(), right = aabb::empty();
+    for (const auto& ref : refs) {
+        (mapping.index(ref.centroid[best.axis]) < best.bin ? left : right).expand(ref.box);
+    }
+
+    aabb overlap;
+    for (int a = 0; a < 3; a++) {
+        overlap.minimum[a] = std::max(left.minimum[a], right.minimum[a]);
+        overlap.maximum[a] = std::min(left.maximum[a], right.maximum[a]);
+        if (overlap.minimum[a] >= overlap.maximum[a]) {
+            return 0;
+        }
+    }
+
+    return overlap.surface_area();
+}
+
+void bvh_builder::bounds_of(const std::vector<reference>& refs, size_t start, size_t end, aabb& box, aabb& centroid_box) const {
+    box = aabb::empty();
+    centroid_box = aabb::empty();
+    for (size_t i = start; i < end; i++) {
+        box.expand(refs[i].box);
+        centroid_box.expand(refs[i].centroid);
+    }
+}
+
+template<typename Bins>
+void bvh_builder::bin_references(const std::vector<reference>& refs, size_t start, size_t end, const bin_mapping* mappings, const bool* active, Bins& bins) const {
+    for (size_t i = start; i < end; i++) {
+        for (int axis = 0; axis < 3; axis++) {
+            if (active[axis]) {
+                bins[axis][mappings[axis].index(refs[i].centroid[axis])].add(refs[i].box);
+            }
+        }
+    }
+}
+
+bvh_builder::split bvh_builder::find_split(const std::vector<reference>& refs, size_t start, size_t end, const aabb& node_box, const aabb& centroid_box) const {
+    // Small nodes don't need more bins than they have primitives
+    const int bin_count = static_cast<int>(std::min<size_t>(options.bin_count, end - start + 1));
+
+    // Left uninitialised on purpose, only the first bin_count entries get used
+    std::array<std::array<bin, max_bin_count>, 3> bins;
+    bin_mapping mappings[3];
+    double right_area[max_bin_count];
+    uint32_t right_count[max_bin_count];
+
+    const double inv_node_area = 1.0 / node_box.surface_area();
+
+    // Bin all three axes in a single pass over the references
+    std::array<bool, 3> active;
+    for (int axis = 0; axis < 3; axis++) {
+        active[axis] = centroid_box.max()[axis] > centroid_box.min()[axis];
+        if (active[axis]) {
+            mappings[axis] = map_bins(centroid_box, axis, bin_count);
+            for (int b = 0; b < bin_count; b++) {
+                bins[axis][b].reset();
+            }
+        }
+    }
+
+    const size_t object_span = end - start;
+    if (deferring && object_span >= parallel_binning_size) {
+        // Large nodes at the top of the tree bin chunks of references on the pool.
+        // Merging only takes mins, maxes and counts so the result matches a serial pass.
+        const size_t chunk_count = std::min<size_t>(worker_threads * 4, object_span / (parallel_binning_size / 4));
+        std::vector<std::array<std::array<bin, max_bin_count>, 3>> chunk_bins(chunk_count);
+
+        pool p;
+        p.num_threads = worker_threads;
+        for (size_t c = 0; c < chunk_count; c++) {
+            p.enqueue_task([&, c]() {
+                const size_t chunk_start = start + object_span * c / chunk_count;
+                const size_t chunk_end = start + object_span * (c + 1) / chunk_count;
+                auto& local = chunk_bins[c];
+                for (int axis = 0; axis < 3; axis++) {
+                    for (int b = 0; b < bin_count; b++) {
+                        local[axis][b].reset();
+                    }
+                }
+                bin_references(refs, chunk_start, chunk_end, mappings, active.data(), local);
+            });
+        }
+        p.start_pool();
+        p.join_threads();
+
+        for (const auto& local : chunk_bins) {
+            for (int axis = 0; axis < 3; axis++) {
+                for (int b = 0; active[axis] && b < bin_count; b++) {
+                    bins[axis][b].add(local[axis][b]);
+                }
+            }
+        }
+    }
+    else {
+        bin_references(refs, start, end, mappings, active.data(), bins);
+    }
+
+    split best;
+
+    for (int axis = 0; axis < 3; axis++) {
+        if (!active[axis]) {
+            continue;
+        }
+
+        // Sweep from the right to get the area and count of everything past each plane
+        bin accumulated;
+        accumulated.reset();
+        for (int b = bin_count - 1; b > 0; b--) {
+            accumulated.add(bins[axis][b]);
+            right_area[b] = accumulated.count > 0 ? accumulated.surface_area() : 0;
+            right_count[b] = accumulated.count;
+        }
+
+        // Then sweep from the left and evaluate the cost of splitting before bin b
+        accumulated.reset();
+        for (int b = 1; b < bin_count; b++) {
+            accumulated.add(bins[axis][b - 1]);
+            const uint32_t count = accumulated.count;
+
+            if (count == 0 || right_count[b] == 0) {
+                continue;
+            }
+
+            double cost = options.traversal_cost + options.intersection_cost * inv_node_area
+                * (accumulated.surface_area() * count + right_area[b] * right_count[b]);
+
+            if (cost < best.cost) {
+                best.cost = cost;
+                best.axis = axis;
+                best.bin = b;
+                best.bin_count = bin_count;
+            }
+        }
+    }
+
+    return best;
+}
+
+bvh_builder::bin_mapping bvh_builder::map_bins(const aabb& centroid_box, int axis, int bin_count) const {
+    // Only called for axes where the centroids have some extent
+    const double extent = centroid_box.max()[axis] - centroid_box.min()[axis];
+    return { centroid_box.min()[axis], bin_count / extent, bin_count - 1 };
+}
+
+double bvh_builder::sah_cost(const std::vector<linear_bvh_node>& nodes) const {
+    if (nodes.empty()) {
+        return 0;
+    }
+
+    // Expected cost of a random ray that hits the root box
+    const double inv_root_area = 1.0 / nodes[0].box.surface_area();
+    double cost = 0;
+
+    for (const auto& node : nodes) {
+        const double probability = node.box.surface_area() * inv_root_area;
+        cost += node.is_leaf()
+            ? probability * options.intersection_cost * node.count
+            : probability * options.traversal_cost;
+    }
+
+    return cost;
+}
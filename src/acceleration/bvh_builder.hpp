@@ -0,0 +1,231 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "acceleration/aabb.hpp"
+#include "utils/util.hpp"
+
+
+// A single node of the flattened bvh. Nodes are stored depth first so the
+// left child of an interior node is always the next node in the array and
+// only the index of the right child has to be stored.
+struct alignas(64) linear_bvh_node {
+    aabb box;
+    // Leaves: index of the first primitive
+    // Interior nodes: index of the right child
+    uint32_t offset = 0;
+    // Number of primitives in a leaf, 0 for interior nodes
+    uint16_t count = 0;
+    // Axis the node was split on
+    uint8_t axis = 0;
+
+    bool is_leaf() const { return count > 0; }
+};
+
+static_assert(sizeof(linear_bvh_node) == 64, "linear_bvh_node should fill exactly one cache line");
+
+// Deepest tree the builder produces, traversal stacks are sized from this
+constexpr int bvh_max_depth = 64;
+
+
+struct bvh_build_options {
+    // Number of buckets centroids are sorted into along each axis, at most max_bin_count
+    int bin_count = 16;
+    // Nodes with more primitives than this are always split
+    int max_leaf_size = 4;
+    // Relative costs of stepping through a node and intersecting a primitive
+    double traversal_cost = 1.0;
+    double intersection_cost = 1.0;
+    // Worker threads used for the build, 0 picks the pool default and 1 builds serially.
+    // The resulting tree is the same whatever this is set to.
+    int threads = 0;
+    // A refit rebuilds subtrees whose SAH cost grew past this multiple of their cost when built
+    double rebuild_threshold = 1.5;
+    // Lets a node split primitives in space instead of only sorting them to
+    // one side, so a primitive can end up referenced from several leaves.
+    // Spatial split builds always run serially.
+    bool spatial_splits = false;
+    // Extra references spatial splits may create, as a fraction of the primitive count
+    double duplication_budget = 0.3;
+    // Spatial splits are only tried where the children of the best object split
+    // overlap by more than this fraction of the root's surface area
+    double spatial_split_overlap = 1e-5;
+    // Built trees are saved here and loaded back by later runs over the same
+    // primitives instead of being built again. Empty turns the cache off.
+    std::string cache_directory;
+};
+
+struct bvh_build_stats {
+    double build_ms = 0;
+    double sah_cost = 0;
+    size_t node_count = 0;
+    size_t leaf_count = 0;
+    int max_depth = 0;
+    // References added by spatial splits on top of one per primitive
+    size_t duplicates = 0;
+    // Loaded from the bvh cache, build_ms is then the time loading took
+    bool from_cache = false;
+};
+
+std::ostream& operator<<(std::ostream& out, const bvh_build_stats& stats);
+
+
+// Builds a flattened bvh over a set of primitive bounds using binned SAH.
+// The builder only ever looks at the precomputed bounds and centroids, so the
+// cost of a node is linear in the number of primitives it holds.
+class bvh_builder {
+public:
+    static constexpr int max_bin_count = 64;
+
+    // Bounds the part of a primitive inside a region, false when there is none
+    using clip_function = std::function<bool(uint32_t index, const aabb& region, aabb& output_box)>;
+
+    // Primitives flagged in unsplittable are never split across leaves. Leaving
+    // it empty allows all of them to be. Without a clip function spatial splits
+    // can only cut the primitive bounds, which rarely tightens round or rotated ones.
+    bvh_builder(const std::vector<aabb>& primitive_bounds, const bvh_build_options& build_options = {},
+        const std::vector<bool>& unsplittable = {}, clip_function clip = {});
+
+    // Fills nodes in depth first order and indices with the primitive order
+    // the leaves reference. With spatial splits a primitive can appear more than once.
+    // first_depth is the depth the root will have, deeper when the tree is
+    // spliced in below another node, so the tree stays within bvh_max_depth.
+    bvh_build_stats build(std::vector<linear_bvh_node>& nodes, std::vector<uint32_t>& indices, int first_depth = 1);
+
+private:
+    // Plain arrays keep this trivially constructible so a whole set of
+    // bins can live on the stack without being zeroed first
+    struct bin {
+        double lower[3];
+        double upper[3];
+        uint32_t count;
+
+        void reset() {
+            for (int a = 0; a < 3; a++) {
+                lower[a] = infinity;
+                upper[a] = -infinity;
+            }
+            count = 0;
+        }
+
+        void add(const aabb& box) {
+            for (int a = 0; a < 3; a++) {
+                lower[a] = fmin(lower[a], box.minimum[a]);
+                upper[a] = fmax(upper[a], box.maximum[a]);
+            }
+            count++;
+        }
+
+        void add(const bin& other) {
+            for (int a = 0; a < 3; a++) {
+                lower[a] = fmin(lower[a], other.lower[a]);
+                upper[a] = fmax(upper[a], other.upper[a]);
+            }
+            count += other.count;
+        }
+
+        double surface_area() const {
+            const double x = upper[0] - lower[0];
+            const double y = upper[1] - lower[1];
+            const double z = upper[2] - lower[2];
+            return 2.0 * (x * y + x * z + y * z);
+        }
+    };
+
+    // Maps a centroid coordinate along one axis to its bin
+    struct bin_mapping {
+        double offset;
+        double scale;
+        int last;
+
+        int index(const double c) const {
+            return std::clamp(static_cast<int>((c - offset) * scale), 0, last);
+        }
+    };
+
+    struct split {
+        int axis = -1;
+        int bin = 0;
+        int bin_count = 0;
+        double cost = infinity;
+    };
+
+    // A primitive as seen by the builder. These are partitioned in place so
+    // every node works on a contiguous block of memory.
+    struct reference {
+        aabb box;
+        point3 centroid;
+        uint32_t index;
+        bool splittable;
+    };
+
+    // A plane that may cut through primitives, those are referenced from both sides
+    struct spatial_split {
+        int axis = -1;
+        double position = 0;
+        double cost = infinity;
+    };
+
+    // Nodes produced by one serial build, either the whole tree or a subtree
+    struct node_list {
+        std::vector<linear_bvh_node> nodes;
+        size_t leaf_count = 0;
+        int max_depth = 0;
+    };
+
+    // A subtree whose build was handed to the pool. Its placeholder in the top
+    // of the tree is replaced by the finished nodes afterwards.
+    struct subtree_task {
+        size_t start;
+        size_t end;
+        int depth;
+        aabb box;
+        aabb centroid_box;
+        uint32_t placeholder;
+        node_list result;
+    };
+
+    uint32_t build_node(node_list& out, size_t start, size_t end, int depth, const aabb& box, const aabb& centroid_box);
+    void bounds_of(const std::vector<reference>& refs, size_t start, size_t end, aabb& box, aabb& centroid_box) const;
+    split find_split(const std::vector<reference>& refs, size_t start, size_t end, const aabb& node_box, const aabb& centroid_box) const;
+    template<typename Bins>
+    void bin_references(const std::vector<reference>& refs, size_t start, size_t end, const bin_mapping* mappings, const bool* active, Bins& bins) const;
+    bin_mapping map_bins(const aabb& centroid_box, int axis, int bin_count) const;
+    void build_parallel(std::vector<linear_bvh_node>& output_nodes, int threads, bvh_build_stats& stats);
+    void build_spatial(std::vector<linear_bvh_node>& output_nodes, std::vector<uint32_t>& output_indices, bvh_build_stats& stats);
+    uint32_t build_spatial_node(node_list& out, std::vector<reference>& refs, std::vector<uint32_t>& indices,
+        int depth, const aabb& box, const aabb& centroid_box);
+    spatial_split find_spatial_split(const std::vector<reference>& refs, const aabb& node_box) const;
+    // Bounds the part of a reference between lower and upper along axis
+    bool clip_reference(const reference& ref, int axis, double lower, double upper, aabb& piece) const;
+    double object_split_overlap(const std::vector<reference>& refs, const split& best, const aabb& centroid_box) const;
+    void splice(const node_list& top, uint32_t index, std::vector<linear_bvh_node>& output_nodes) const;
+    double sah_cost(const std::vector<linear_bvh_node>& nodes) const;
+
+    // Below these sizes the pool costs more than it saves
+    static constexpr size_t min_subtree_size = 4096;
+    static constexpr size_t parallel_binning_size = 1 << 16;
+
+    std::vector<reference> references;
+    bvh_build_options options;
+
+    int root_depth = 1;
+
+    // Set while the top of the tree is built on the calling thread
+    bool deferring = false;
+    int worker_threads = 1;
+    size_t subtree_size = 0;
+    std::vector<subtree_task> subtrees;
+    std::vector<int> subtree_of_node;
+
+    // Spatial split state
+    clip_function clip;
+    size_t duplicates = 0;
+    size_t max_duplicates = 0;
+    double root_area = 0;
+};
@@ -0,0 +1,152 @@
+#include "acceleration/bvh_cache.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+
+namespace {
+
+// "RTBVHC" in the first bytes of every cache file
+constexpr uint64_t bvh_cache_magic = 0x0000434856425452ull;
+
+// Sections start on cache line boundaries
+constexpr size_t bvh_cache_alignment = 64;
+
+struct bvh_cache_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t section_count;
+    uint64_t key;
+};
+
+// Followed by the table of sections, then the sections themselves
+struct bvh_cache_entry {
+    uint64_t offset;
+    uint64_t size;
+};
+
+size_t align_up(const size_t offset) {
+    return (offset + bvh_cache_alignment - 1) / bvh_cache_alignment * bvh_cache_alignment;
+}
+
+uint64_t mix(uint64_t state, const uint64_t word) {
+    state = (state ^ word) * 0x9e3779b97f4a7c15ull;
+    return state ^ (state >> 32);
+}
+
+}
+
+void content_hash::add(const void* data, const size_t size) {
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        state = mix(state, word);
+    }
+
+    uint64_t tail = 0;
+    std::memcpy(&tail, bytes + i, size - i);
+    state = mix(state, tail ^ (static_cast<uint64_t>(size - i) << 56));
+}
+
+void content_hash::add(const bvh_build_options& options) {
+    // Only what shapes the tree, the thread count and rebuild threshold don't
+    add(options.bin_count);
+    add(options.max_leaf_size);
+    add(options.traversal_cost);
+    add(options.intersection_cost);
+    add(options.spatial_splits);
+    add(options.duplication_budget);
+    add(options.spatial_split_overlap);
+    add(sizeof(linear_bvh_node));
+}
+
+std::string bvh_cache_path(const std::string& directory, const uint64_t key) {
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << key << ".bvh";
+    return (std::filesystem::path(directory) / name.str()).string();
+}
+
+bool write_bvh_cache(const std::string& directory, const uint64_t key, const std::vector<bvh_cache_section>& sections) {
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+        std::cerr << "Could not create bvh cache directory " << directory << ": " << error.message() << "\n";
+        return false;
+    }
+
+    const bvh_cache_header header = { bvh_cache_magic, bvh_cache_version, static_cast<uint32_t>(sections.size()), key };
+    std::vector<bvh_cache_entry> entries(sections.size());
+    size_t offset = align_up(sizeof(header) + entries.size() * sizeof(bvh_cache_entry));
+    for (size_t i = 0; i < sections.size(); i++) {
+        entries[i] = { offset, sections[i].size };
+        offset = align_up(offset + sections[i].size);
+    }
+
+    const std::string path = bvh_cache_path(directory, key);
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        const char padding[bvh_cache_alignment] = {};
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(bvh_cache_entry));
+        size_t written = sizeof(header) + entries.size() * sizeof(bvh_cache_entry);
+        for (size_t i = 0; i < sections.size(); i++) {
+            out.write(padding, entries[i].offset - written);
+            out.write(static_cast<const char*>(sections[i].data), sections[i].size);
+            written = entries[i].offset + sections[i].size;
+        }
+
+        if (!out) {
+            std::cerr << "Could not write bvh cache " << temporary << ".\n";
+            out.close();
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::cerr << "Could not move bvh cache into place at " << path << ": " << error.message() << "\n";
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+bvh_cache_file::bvh_cache_file(const std::string& directory, const uint64_t key) : file(bvh_cache_path(directory, key)) {
+    // A missing file is the usual miss and isn't worth a message
+    if (!file.is_open()) {
+        return;
+    }
+
+    const std::string_view contents = file.contents();
+    bvh_cache_header header;
+    if (contents.size() < sizeof(header)) {
+        return;
+    }
+    std::memcpy(&header, contents.data(), sizeof(header));
+    if (header.magic != bvh_cache_magic || header.version != bvh_cache_version || header.key != key) {
+        return;
+    }
+
+    const size_t table_end = sizeof(header) + static_cast<size_t>(header.section_count) * sizeof(bvh_cache_entry);
+    if (contents.size() < table_end) {
+        return;
+    }
+
+    std::vector<std::string_view> found(header.section_count);
+    for (size_t i = 0; i < header.section_count; i++) {
+        bvh_cache_entry entry;
+        std::memcpy(&entry, contents.data() + sizeof(header) + i * sizeof(bvh_cache_entry), sizeof(entry));
+        if (entry.offset > contents.size() || entry.size > contents.size() - entry.offset) {
+            std::cerr << "Truncated bvh cache " << bvh_cache_path(directory, key) << ", it will be rebuilt.\n";
+            return;
+        }
+        found[i] = contents.substr(entry.offset, entry.size);
+    }
+    sections = std::move(found);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "acceleration/bvh_builder.hpp"
+#include "utils/mapped_file.hpp"
+
+
+// Built bvhs can be saved to disk and mapped back in on later runs instead of
+// being built again. A file holds a list of plain arrays and is found by a
+// hash of everything the build depended on, so a changed scene simply misses.
+// Offsets in the file are relative to its start, the arrays hold indices
+// rather than pointers and can be used wherever the file gets mapped.
+
+// Bump whenever the layout of the file or of anything stored in it changes
+constexpr uint32_t bvh_cache_version = 1;
+
+// 64 bit content hash, fed with the inputs of a build
+class content_hash {
+public:
+    void add(const void* data, size_t size);
+    void add(const bvh_build_options& options);
+
+    template<typename T>
+    void add(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        add(&value, sizeof(T));
+    }
+
+    template<typename T>
+    void add(const std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        add(values.size());
+        add(values.data(), values.size() * sizeof(T));
+    }
+
+    uint64_t value() const { return state; }
+
+private:
+    uint64_t state = 0x243f6a8885a308d3;
+};
+
+// Where the cache file with this key lives in a directory
+std::string bvh_cache_path(const std::string& directory, uint64_t key);
+
+// One array written to a cache file
+struct bvh_cache_section {
+    const void* data;
+    size_t size;
+
+    template<typename T>
+    static bvh_cache_section of(const std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        return { values.data(), values.size() * sizeof(T) };
+    }
+};
+
+// Writes to a temporary file first and renames it into place, so a run that
+// reads the cache at the same time never sees half a file. Returns false on failure.
+bool write_bvh_cache(const std::string& directory, uint64_t key, const std::vector<bvh_cache_section>& sections);
+
+// A cache file mapped into memory. It is only valid when it exists and was
+// written under the same key and version.
+class bvh_cache_file {
+public:
+    bvh_cache_file(const std::string& directory, uint64_t key);
+
+    bool valid() const { return !sections.empty(); }
+
+    // Copies a section out of the mapping, false when its size doesn't fit T
+    template<typename T>
+    bool read(size_t index, std::vector<T>& values) const {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (index >= sections.size() || sections[index].size() % sizeof(T) != 0) {
+            return false;
+        }
+        values.resize(sections[index].size() / sizeof(T));
+        std::memcpy(values.data(), sections[index].data(), sections[index].size());
+        return true;
+    }
+
+    template<typename T>
+    bool read(size_t index, T& value) const {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (index >= sections.size() || sections[index].size() != sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, sections[index].data(), sizeof(T));
+        return true;
+    }
+
+private:
+    mapped_file file;
+    std::vector<std::string_view> sections;
+};
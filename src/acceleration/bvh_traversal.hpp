@@ -0,0 +1,148 @@
+#pragma once
+
+#include <array>
+#include <utility>
+#include <vector>
+
+#include "acceleration/bvh_builder.hpp"
+#include "acceleration/traversal_stats.hpp"
+#include "core/ray.hpp"
+#include "scene/hittable.hpp"
+
+
+// Traversal loops for primitives that keep a flattened bvh of their own, like
+// box_set and triangle_mesh. What a leaf holds is up to the caller, so leaves
+// are handed to a callback.
+
+// Walks the tree front to back. leaf(node, t_max) tests the primitives of a
+// leaf, lowers t_max to the closest hit it finds and returns whether it found
+// one. Returns whether any leaf did, t_max ends up at the closest hit.
+template<typename Leaf>
+bool traverse_closest(const std::vector<linear_bvh_node>& nodes, const ray& r, double t_min, double& t_max, Leaf&& leaf) {
+    if constexpr (enable_traversal_stats) {
+        thread_traversal_stats().box_tests++;
+    }
+
+    double t_root;
+    if (nodes.empty() || !nodes[0].box.hit(r, t_min, t_max, t_root)) {
+        return false;
+    }
+
+    // Far children wait here along with the distance at which the ray enters them
+    std::array<std::pair<uint32_t, double>, bvh_max_depth> stack;
+    int stack_size = 0;
+    uint32_t current = 0;
+    bool hit_anything = false;
+
+    while (true) {
+        const linear_bvh_node& node = nodes[current];
+        if constexpr (enable_traversal_stats) {
+            thread_traversal_stats().nodes_visited++;
+        }
+
+        if (node.is_leaf()) {
+            hit_anything |= leaf(node, t_max);
+        }
+        else {
+            // The right child holds the larger coordinates along the split
+            // axis, so it is the nearer one for rays pointing the other way
+            const bool right_first = r.sign[node.axis];
+            const uint32_t near_child = right_first ? node.offset : current + 1;
+            const uint32_t far_child = right_first ? current + 1 : node.offset;
+
+            double t_near, t_far;
+            const bool hit_near = nodes[near_child].box.hit(r, t_min, t_max, t_near);
+            const bool hit_far = nodes[far_child].box.hit(r, t_min, t_max, t_far);
+            if constexpr (enable_traversal_stats) {
+                thread_traversal_stats().box_tests += 2;
+            }
+
+            if (hit_near) {
+                if (hit_far) {
+                    stack[stack_size++] = { far_child, t_far };
+                }
+                current = near_child;
+                continue;
+            }
+            if (hit_far) {
+                current = far_child;
+                continue;
+            }
+        }
+
+        // Drop far children the ray only reaches beyond the closest hit so far
+        while (stack_size > 0 && stack[stack_size - 1].second > t_max) {
+            stack_size--;
+        }
+        if (stack_size == 0) {
+            break;
+        }
+        current = stack[--stack_size].first;
+    }
+
+    return hit_anything;
+}
+
+// Stops at the first leaf for which leaf(node) returns true. Any hit will
+// do, so children are visited in whatever order they come.
+template<typename Leaf>
+bool traverse_any(const std::vector<linear_bvh_node>& nodes, const ray& r, double t_min, double t_max, Leaf&& leaf) {
+    if constexpr (enable_traversal_stats) {
+        thread_traversal_stats().box_tests++;
+    }
+
+    if (nodes.empty() || !nodes[0].box.hit(r, t_min, t_max)) {
+        return false;
+    }
+
+    std::array<uint32_t, bvh_max_depth> stack;
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+
+    while (stack_size > 0) {
+        const uint32_t index = stack[--stack_size];
+        const linear_bvh_node& node = nodes[index];
+        if constexpr (enable_traversal_stats) {
+            thread_traversal_stats().nodes_visited++;
+        }
+
+        if (node.is_leaf()) {
+            if (leaf(node)) {
+                return true;
+            }
+            continue;
+        }
+
+        if constexpr (enable_traversal_stats) {
+            thread_traversal_stats().box_tests += 2;
+        }
+        if (nodes[node.offset].box.hit(r, t_min, t_max)) {
+            stack[stack_size++] = node.offset;
+        }
+        if (nodes[index + 1].box.hit(r, t_min, t_max)) {
+            stack[stack_size++] = index + 1;
+        }
+    }
+
+    return false;
+}
+
+// Children of the pointer based trees, bvh_node and improved_bvh_node, whose
+// left child holds the smaller coordinates along the split axis.
+
+// Enters the child nearer along the split axis first. The far child is then
+// only searched up to the closest hit, so its box turns the ray away when the
+// ray enters it beyond that hit.
+inline bool hit_children(const hittable& left, const hittable& right, int axis, const ray& r, double t_min, double t_max, hit_record& rec) {
+    const hittable& near_child = r.sign[axis] ? right : left;
+    const hittable& far_child = r.sign[axis] ? left : right;
+
+    const bool hit_near = near_child.hit(r, t_min, t_max, rec);
+    const bool hit_far = far_child.hit(r, t_min, hit_near ? rec.t : t_max, rec);
+    return hit_near || hit_far;
+}
+
+// Any hit ends the search, so there is no point in ordering the children
+inline bool children_occluded(const hittable& left, const hittable& right, const ray& r, double t_min, double t_max) {
+    return left.occluded(r, t_min, t_max) || right.occluded(r, t_min, t_max);
+}
@@ -1,4 +1,5 @@
 #include "acceleration/improved_bvh.hpp"
+#include "acceleration/bvh_traversal.hpp"
 
 improved_bvh_node::improved_bvh_node(
     std::vector<std::shared_ptr<hittable>>& objects,
@@ -15,9 +16,22 @@ improved_bvh_node::improved_bvh_node(
         left = right = objects[start];
     }
     else if (object_span == 2) {
-        // These objects are already sorted by the axis, so we can just assign them
+        // Split the pair along the axis their centers are furthest apart on,
+        // so hit can tell which of them is nearer
+        aabb box_a, box_b;
+        objects[start]->bounding_box(box_a);
+        objects[start + 1]->bounding_box(box_b);
+
+        auto centers = aabb::empty();
+        centers.expand(box_a.center());
+        centers.expand(box_b.center());
+        axis = centers.longest_axis();
+
         left = objects[start];
         right = objects[start + 1];
+        if (comparators[axis](right, left)) {
+            std::swap(left, right);
+        }
     }
     else {
         // Test all three axes and splits to find the best SAH
@@ -44,6 +58,7 @@ improved_bvh_node::improved_bvh_node(
 
 
         std::sort(objects.begin() + start, objects.begin() + end, comparators[best_axis]);
+        axis = best_axis;
         // auto mid = start + best_split;
 
         left = std::make_shared<improved_bvh_node>(objects, start, best_split);
@@ -61,14 +76,34 @@ improved_bvh_node::improved_bvh_node(
 
 
 bool improved_bvh_node::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    if constexpr (enable_traversal_stats) {
+        thread_traversal_stats().box_tests++;
+    }
+
     if (!box.hit(r, t_min, t_max)) {
         return false;
     }
 
-    bool hit_left = left->hit(r, t_min, t_max, rec);
-    bool hit_right = right->hit(r, t_min, hit_left ? rec.t : t_max, rec);
+    if constexpr (enable_traversal_stats) {
+        thread_traversal_stats().nodes_visited++;
+        thread_traversal_stats().enter();
+    }
+
+    const bool hit_any = hit_children(*left, *right, axis, r, t_min, t_max, rec);
+
+    if constexpr (enable_traversal_stats) {
+        thread_traversal_stats().leave();
+    }
+
+    return hit_any;
+}
+
+bool improved_bvh_node::occluded(const ray& r, double t_min, double t_max) const {
+    if constexpr (enable_traversal_stats) {
+        thread_traversal_stats().box_tests++;
+    }
 
-    return hit_left || hit_right;
+    return box.hit(r, t_min, t_max) && children_occluded(*left, *right, r, t_min, t_max);
 }
 
 bool improved_bvh_node::bounding_box(aabb& output_box) const {
@@ -8,6 +8,7 @@
 #include <numeric>
 
 #include "acceleration/aabb.hpp"
+#include "acceleration/traversal_stats.hpp"
 #include "scene/hittable.hpp"
 #include "scene/hittable_list.hpp"
 #include "utils/util.hpp"
@@ -26,6 +27,10 @@ public:
 
     virtual bool bounding_box(aabb& output_box) const override;
 
+    virtual bool random_hit() const override { return left->random_hit() || right->random_hit(); }
+
+    virtual bool occluded(const ray& r, double t_min, double t_max) const override;
+
 private:
     double split_sah(std::vector<std::shared_ptr<hittable>>& objects, size_t start, size_t end, size_t split) const;
     double surface_area(std::vector<std::shared_ptr<hittable>>& objects, size_t start, size_t end) const;
@@ -34,4 +39,6 @@ public:
     std::shared_ptr<hittable> left;
     std::shared_ptr<hittable> right;
     aabb box;
+    // Axis the children were split along, right holds the larger coordinates
+    int axis = 0;
 };
\ No newline at end of file
@@ -0,0 +1,453 @@
+#include "acceleration/linear_bvh.hpp"
+
+#include <bit>
+#include <chrono>
+#include <iostream>
+#include <tuple>
+
+#include "acceleration/bvh_cache.hpp"
+
+linear_bvh::linear_bvh(const std::vector<std::shared_ptr<hittable>>& objects, const bvh_build_options& build_options)
+    : options(build_options) {
+    // Bounds are gathered once up front so the build never calls back into the primitives
+    std::vector<aabb> bounds(objects.size());
+    for (size_t i = 0; i < objects.size(); i++) {
+        if (!objects[i]->bounding_box(bounds[i])) {
+            std::cerr << "No bounding box in linear_bvh constructor.\n";
+        }
+    }
+
+    // Anything whose hit draws random numbers has to stay in a single leaf
+    std::vector<bool> unsplittable;
+    if (options.spatial_splits) {
+        unsplittable.resize(objects.size());
+        for (size_t i = 0; i < objects.size(); i++) {
+            unsplittable[i] = objects[i]->random_hit();
+        }
+    }
+
+    // Lets spatial splits cut the primitives themselves rather than only their boxes
+    auto clip = [&objects](uint32_t index, const aabb& region, aabb& output_box) {
+        return objects[index]->clipped_box(region, output_box);
+    };
+
+    // A spatial split tree also depends on the shape of each primitive, which the bounds don't capture
+    const bool cached = !options.cache_directory.empty() && !options.spatial_splits;
+    uint64_t key = 0;
+    if (cached) {
+        content_hash hash;
+        hash.add(options);
+        hash.add(bounds);
+        key = hash.value();
+    }
+
+    if (!cached || !load_cached(key, objects.size())) {
+        stats = bvh_builder(bounds, options, unsplittable, clip).build(nodes, object_of);
+        if (cached) {
+            write_bvh_cache(options.cache_directory, key,
+                { bvh_cache_section::of(nodes), bvh_cache_section::of(object_of), { &stats, sizeof(stats) } });
+        }
+    }
+
+    // Store the primitives in leaf order, spatial splits can list one more than once
+    primitives.reserve(object_of.size());
+    primitive_bounds.reserve(object_of.size());
+    slot_of.resize(objects.size());
+    for (size_t slot = 0; slot < object_of.size(); slot++) {
+        primitives.push_back(objects[object_of[slot]]);
+        primitive_bounds.push_back(bounds[object_of[slot]]);
+        slot_of[object_of[slot]] = static_cast<uint32_t>(slot);
+    }
+
+    // The builder's boxes are kept, spatial splits make them tighter than the primitive bounds
+    refit_nodes(build_costs, false);
+}
+
+bool linear_bvh::load_cached(const uint64_t key, const size_t object_count) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    bvh_cache_file file(options.cache_directory, key);
+    if (!file.valid() || !file.read(0, nodes) || !file.read(1, object_of) || !file.read(2, stats) || nodes.empty()
+        || std::any_of(object_of.begin(), object_of.end(), [&](uint32_t index) { return index >= object_count; })) {
+        nodes.clear();
+        object_of.clear();
+        return false;
+    }
+
+    stats.from_cache = true;
+    stats.build_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    return true;
+}
+
+bool linear_bvh::random_hit() const {
+    return std::any_of(primitives.begin(), primitives.end(), [](const auto& object) { return object->random_hit(); });
+}
+
+void linear_bvh::set_primitive(size_t index, std::shared_ptr<hittable> object) {
+    aabb box;
+    if (!object->bounding_box(box)) {
+        std::cerr << "No bounding box in linear_bvh::set_primitive.\n";
+    }
+
+    if (primitives.size() == slot_of.size()) {
+        primitive_bounds[slot_of[index]] = box;
+        primitives[slot_of[index]] = std::move(object);
+        return;
+    }
+
+    // Spatial splits duplicated some primitives, look for every copy
+    for (size_t slot = 0; slot < primitives.size(); slot++) {
+        if (object_of[slot] == index) {
+            primitive_bounds[slot] = box;
+            primitives[slot] = object;
+        }
+    }
+}
+
+int linear_bvh::refit() {
+    std::vector<double> costs;
+    refit_nodes(costs);
+
+    // Only the topmost degraded subtrees are rebuilt, that covers everything below them
+    std::vector<uint32_t> degraded;
+    for (uint32_t i = 0; i < nodes.size();) {
+        if (!nodes[i].is_leaf() && costs[i] > options.rebuild_threshold * build_costs[i]) {
+            degraded.push_back(i);
+            i = subtree_end(i);
+        }
+        else {
+            i++;
+        }
+    }
+
+    if (degraded.empty()) {
+        stats.sah_cost = nodes.empty() ? 0 : costs[0];
+        return 0;
+    }
+
+    // Splicing a subtree moves every node after it, so go from the back
+    for (auto it = degraded.rbegin(); it != degraded.rend(); ++it) {
+        rebuild_subtree(*it);
+    }
+
+    // The rebuilt nodes become the new reference for later refits
+    refit_nodes(costs);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (build_costs[i] < 0) {
+            build_costs[i] = costs[i];
+        }
+    }
+
+    stats.sah_cost = costs[0];
+    stats.node_count = nodes.size();
+    stats.leaf_count = std::count_if(nodes.begin(), nodes.end(), [](const linear_bvh_node& node) { return node.is_leaf(); });
+    stats.max_depth = tree_depth();
+    if (stats.max_depth > bvh_max_depth) {
+        std::cerr << "Refit left a bvh " << stats.max_depth << " levels deep, traversal only handles " << bvh_max_depth << "\n";
+    }
+
+    return static_cast<int>(degraded.size());
+}
+
+void linear_bvh::refit_nodes(std::vector<double>& costs, bool fit_boxes) {
+    costs.resize(nodes.size());
+
+    // Children are always stored after their parent, so walking backwards
+    // finishes both children before the parent is reached
+    for (size_t i = nodes.size(); i-- > 0;) {
+        auto& node = nodes[i];
+        // The cost of a subtree times the area of its box
+        double weighted_cost;
+
+        if (node.is_leaf()) {
+            if (fit_boxes) {
+                node.box = aabb::empty();
+                for (uint32_t p = node.offset; p < node.offset + node.count; p++) {
+                    node.box.expand(primitive_bounds[p]);
+                }
+            }
+            weighted_cost = node.box.surface_area() * options.intersection_cost * node.count;
+        }
+        else {
+            const auto& left = nodes[i + 1];
+            const auto& right = nodes[node.offset];
+            if (fit_boxes) {
+                node.box = surrounding_box(left.box, right.box);
+            }
+            weighted_cost = node.box.surface_area() * options.traversal_cost
+                + left.box.surface_area() * costs[i + 1]
+                + right.box.surface_area() * costs[node.offset];
+        }
+
+        const double area = node.box.surface_area();
+        costs[i] = area > 0 ? weighted_cost / area : 0;
+    }
+}
+
+uint32_t linear_bvh::subtree_end(uint32_t index) const {
+    // The last node of a subtree is the bottom of its rightmost path
+    while (!nodes[index].is_leaf()) {
+        index = nodes[index].offset;
+    }
+    return index + 1;
+}
+
+int linear_bvh::node_depth(uint32_t index) const {
+    // The first child's subtree ends where the second child starts
+    uint32_t current = 0;
+    int depth = 1;
+    while (current != index) {
+        current = index < nodes[current].offset ? current + 1 : nodes[current].offset;
+        depth++;
+    }
+    return depth;
+}
+
+int linear_bvh::tree_depth() const {
+    // Depths along the depth first order, second children wait for their turn
+    std::vector<int> depth_at(nodes.size(), 1);
+    int deepest = 0;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        deepest = std::max(deepest, depth_at[i]);
+        if (!nodes[i].is_leaf()) {
+            depth_at[i + 1] = depth_at[i] + 1;
+            depth_at[nodes[i].offset] = depth_at[i] + 1;
+        }
+    }
+    return deepest;
+}
+
+void linear_bvh::rebuild_subtree(uint32_t index) {
+    const uint32_t end = subtree_end(index);
+
+    // A subtree covers a contiguous range of primitives, from its leftmost to its rightmost leaf
+    uint32_t leftmost = index;
+    while (!nodes[leftmost].is_leaf()) {
+        leftmost++;
+    }
+    const uint32_t first = nodes[leftmost].offset;
+    const uint32_t last = nodes[end - 1].offset + nodes[end - 1].count;
+
+    std::vector<aabb> bounds(primitive_bounds.begin() + first, primitive_bounds.begin() + last);
+    std::vector<linear_bvh_node> subtree;
+    std::vector<uint32_t> indices;
+    // The range has to come back with exactly as many references as it had
+    auto subtree_options = options;
+    subtree_options.spatial_splits = false;
+    // Built at the depth it is spliced in at, so the equal count splits near
+    // the bottom still keep the whole tree within the traversal stacks
+    bvh_builder(bounds, subtree_options).build(subtree, indices, node_depth(index));
+
+    // Put the range into the new leaf order
+    std::vector<std::shared_ptr<hittable>> old_primitives(primitives.begin() + first, primitives.begin() + last);
+    std::vector<uint32_t> old_objects(object_of.begin() + first, object_of.begin() + last);
+    for (uint32_t k = 0; k < indices.size(); k++) {
+        const uint32_t slot = first + k;
+        primitives[slot] = std::move(old_primitives[indices[k]]);
+        primitive_bounds[slot] = bounds[indices[k]];
+        object_of[slot] = old_objects[indices[k]];
+        slot_of[object_of[slot]] = slot;
+    }
+
+    // The new nodes were numbered from 0, move them to where the subtree sits
+    for (auto& node : subtree) {
+        node.offset += node.is_leaf() ? first : index;
+    }
+
+    // Right children after the subtree move by however much it grew or shrank
+    const int64_t delta = static_cast<int64_t>(subtree.size()) - (end - index);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if ((i < index || i >= end) && !nodes[i].is_leaf() && nodes[i].offset >= end) {
+            nodes[i].offset = static_cast<uint32_t>(nodes[i].offset + delta);
+        }
+    }
+
+    nodes.erase(nodes.begin() + index, nodes.begin() + end);
+    nodes.insert(nodes.begin() + index, subtree.begin(), subtree.end());
+
+    // Marked so refit takes the fresh costs as the new reference
+    build_costs.erase(build_costs.begin() + index, build_costs.begin() + end);
+    build_costs.insert(build_costs.begin() + index, subtree.size(), -1.0);
+}
+
+bool linear_bvh::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    if constexpr (enable_traversal_stats) {
+        thread_traversal_stats().box_tests++;
+    }
+
+    double t_root;
+    if (nodes.empty() || !nodes[0].box.hit(r, t_min, t_max, t_root)) {
+        return false;
+    }
+
+    // Far children wait here along with the distance at which the ray enters them
+    std::array<std::pair<uint32_t, double>, bvh_max_depth> stack;
+    int stack_size = 0;
+    uint32_t current = 0;
+
+    bool hit_anything = false;
+    double closest_so_far = t_max;
+
+    while (true) {
+        const linear_bvh_node& node = nodes[current];
+        if constexpr (enable_traversal_stats) {
+            thread_traversal_stats().nodes_visited++;
+        }
+
+        if (node.is_leaf()) {
+            for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                if (primitives[i]->hit(r, t_min, closest_so_far, rec)) {
+                    hit_anything = true;
+                    closest_so_far = rec.t;
+                }
+            }
+            if constexpr (enable_traversal_stats) {
+                thread_traversal_stats().primitive_tests += node.count;
+            }
+        }
+        else {
+            // The right child holds the larger coordinates along the split
+            // axis, so it is the nearer one for rays pointing the other way
+            const bool right_first = r.sign[node.axis];
+            const uint32_t near_child = right_first ? node.offset : current + 1;
+            const uint32_t far_child = right_first ? current + 1 : node.offset;
+
+            double t_near, t_far;
+            const bool hit_near = nodes[near_child].box.hit(r, t_min, closest_so_far, t_near);
+            const bool hit_far = nodes[far_child].box.hit(r, t_min, closest_so_far, t_far);
+            if constexpr (enable_traversal_stats) {
+                thread_traversal_stats().box_tests += 2;
+            }
+
+            if (hit_near) {
+                if (hit_far) {
+                    stack[stack_size++] = { far_child, t_far };
+                    if constexpr (enable_traversal_stats) {
+                        auto& counters = thread_traversal_stats();
+                        counters.max_depth = std::max(counters.max_depth, stack_size);
+                    }
+                }
+                current = near_child;
+                continue;
+            }
+            if (hit_far) {
+                current = far_child;
+                continue;
+            }
+        }
+
+        // Drop far children the ray only reaches beyond the closest hit so far
+        while (stack_size > 0 && stack[stack_size - 1].second > closest_so_far) {
+            stack_size--;
+        }
+        if (stack_size == 0) {
+            break;
+        }
+        current = stack[--stack_size].first;
+    }
+
+    return hit_anything;
+}
+
+bool linear_bvh::occluded(const ray& r, double t_min, double t_max) const {
+    if constexpr (enable_traversal_stats) {
+        thread_traversal_stats().box_tests++;
+    }
+
+    if (nodes.empty() || !nodes[0].box.hit(r, t_min, t_max)) {
+        return false;
+    }
+
+    // Any hit ends the search, so children go on the stack in whatever order
+    // they come and nothing has to be remembered about them
+    std::array<uint32_t, bvh_max_depth> stack;
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+
+    while (stack_size > 0) {
+        const uint32_t index = stack[--stack_size];
+        const linear_bvh_node& node = nodes[index];
+        if constexpr (enable_traversal_stats) {
+            thread_traversal_stats().nodes_visited++;
+        }
+
+        if (node.is_leaf()) {
+            if constexpr (enable_traversal_stats) {
+                thread_traversal_stats().primitive_tests += node.count;
+            }
+            for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                if (primitives[i]->occluded(r, t_min, t_max)) {
+                    return true;
+                }
+            }
+            continue;
+        }
+
+        if constexpr (enable_traversal_stats) {
+            thread_traversal_stats().box_tests += 2;
+        }
+        if (nodes[node.offset].box.hit(r, t_min, t_max)) {
+            stack[stack_size++] = node.offset;
+        }
+        if (nodes[index + 1].box.hit(r, t_min, t_max)) {
+            stack[stack_size++] = index + 1;
+        }
+    }
+
+    return false;
+}
+
+packet_mask linear_bvh::hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const {
+    if (nodes.empty() || !active) {
+        return 0;
+    }
+
+    // Every entry carries the rays that reached it, so a subtree is only
+    // tested against the rays that hit its parent
+    std::array<std::pair<uint32_t, packet_mask>, bvh_max_depth> stack;
+    int stack_size = 0;
+    uint32_t current = 0;
+    packet_mask mask = active;
+
+    // The rays are coherent, so the first one decides which child is nearer
+    const ray& lead = packet.rays[std::countr_zero(active)];
+
+    alignas(64) std::array<double, packet_size> t_enter;
+    packet_mask hit_mask = 0;
+
+    while (true) {
+        const linear_bvh_node& node = nodes[current];
+        mask = node.box.hit(packet, t_min, hits.t_max, mask, t_enter);
+
+        if (mask) {
+            if (node.is_leaf()) {
+                for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                    hit_mask |= primitives[i]->hit_packet(packet, t_min, hits, mask);
+                }
+            }
+            else {
+                // The right child holds the larger coordinates along the split axis
+                const bool right_first = lead.sign[node.axis];
+                stack[stack_size++] = { right_first ? current + 1 : node.offset, mask };
+                current = right_first ? node.offset : current + 1;
+                continue;
+            }
+        }
+
+        if (stack_size == 0) {
+            break;
+        }
+        std::tie(current, mask) = stack[--stack_size];
+    }
+
+    return hit_mask;
+}
+
+bool linear_bvh::bounding_box(aabb& output_box) const {
+    if (nodes.empty()) {
+        return false;
+    }
+
+    output_box = nodes[0].box;
+    return true;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include "acceleration/aabb.hpp"
+#include "acceleration/bvh_builder.hpp"
+#include "acceleration/traversal_stats.hpp"
+#include "scene/hittable.hpp"
+#include "scene/hittable_list.hpp"
+#include "utils/util.hpp"
+
+
+// A bvh stored as a contiguous array of nodes that is traversed iteratively.
+// Primitives are reordered so every leaf references a contiguous range.
+class linear_bvh : public hittable {
+public:
+    linear_bvh() = default;
+
+    linear_bvh(const hittable_list& list, const bvh_build_options& options = {}) : linear_bvh(list.objects, options) {}
+
+    linear_bvh(const std::vector<std::shared_ptr<hittable>>& objects, const bvh_build_options& options = {});
+
+    virtual bool hit(
+        const ray& r, double t_min, double t_max, hit_record& rec) const override;
+
+    virtual packet_mask hit_packet(
+        const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const override;
+
+    virtual bool bounding_box(aabb& output_box) const override;
+
+    virtual bool random_hit() const override;
+
+    virtual bool occluded(const ray& r, double t_min, double t_max) const override;
+
+    // Objects are addressed by their position in the list the bvh was built from
+    std::shared_ptr<hittable> primitive(size_t index) const { return primitives[slot_of[index]]; }
+
+    // Replaces an object, for example with a moved or rotated copy of itself.
+    // The tree only takes the new bounds into account on the next refit.
+    void set_primitive(size_t index, std::shared_ptr<hittable> object);
+
+    // Recomputes every box bottom up in O(n) after objects were replaced, then
+    // rebuilds the subtrees whose SAH cost degraded past options.rebuild_threshold.
+    // Returns how many subtrees were rebuilt. Wide bvhs collapsed from this
+    // one keep their old boxes and have to be collapsed again.
+    int refit();
+
+private:
+    // Takes the tree from the bvh cache, false when it has none for this key
+    bool load_cached(uint64_t key, size_t object_count);
+    // Fits every box to its children and writes the SAH cost of each subtree.
+    // Refitting loosens the clipped boxes of a spatial split build back to
+    // the full primitive bounds.
+    void refit_nodes(std::vector<double>& costs, bool fit_boxes = true);
+    // One past the last node of the subtree rooted at index
+    uint32_t subtree_end(uint32_t index) const;
+    // Depth of the node at index, the root has depth 1
+    int node_depth(uint32_t index) const;
+    // Depth of the deepest leaf
+    int tree_depth() const;
+    void rebuild_subtree(uint32_t index);
+
+public:
+    std::vector<linear_bvh_node> nodes;
+    std::vector<std::shared_ptr<hittable>> primitives;
+    bvh_build_stats stats;
+
+private:
+    bvh_build_options options;
+    // Bounds of the primitives, in leaf order
+    std::vector<aabb> primitive_bounds;
+    // Leaf order position of every object and the object at every position
+    std::vector<uint32_t> slot_of;
+    std::vector<uint32_t> object_of;
+    // SAH cost of every subtree when it was built, refit compares against these
+    std::vector<double> build_costs;
+};
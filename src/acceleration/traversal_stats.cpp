@@ -0,0 +1,13 @@
+#include "acceleration/traversal_stats.hpp"
+
+std::ostream& operator<<(std::ostream& out, const traversal_stats& stats) {
+    const double rays = stats.rays > 0 ? static_cast<double>(stats.rays) : 1.0;
+    return out << stats.nodes_visited / rays << " nodes, "
+        << stats.box_tests / rays << " box tests, "
+        << stats.primitive_tests / rays << " primitive tests per ray, depth " << stats.max_depth;
+}
+
+traversal_stats& thread_traversal_stats() {
+    static thread_local traversal_stats stats;
+    return stats;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+
+
+// Counting what the bvh traversals do costs time on every box test, so it is
+// compiled out unless this is set to true
+constexpr bool enable_traversal_stats = false;
+
+struct traversal_stats {
+    uint64_t rays = 0;
+    uint64_t nodes_visited = 0;
+    uint64_t box_tests = 0;
+    uint64_t primitive_tests = 0;
+    // Deepest the traversal stack or recursion got
+    int max_depth = 0;
+    // Current recursion depth of the pointer based trees
+    int depth = 0;
+
+    void reset() { *this = traversal_stats(); }
+
+    void enter() {
+        if (++depth > max_depth) {
+            max_depth = depth;
+        }
+    }
+
+    void leave() { depth--; }
+};
+
+std::ostream& operator<<(std::ostream& out, const traversal_stats& stats);
+
+// Counters of the calling thread
+traversal_stats& thread_traversal_stats();
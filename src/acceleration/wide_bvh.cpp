@@ -0,0 +1,462 @@
+#include "acceleration/wide_bvh.hpp"
+
+#include <bit>
+
+#if defined(__SSE2__)
+// GCC 12 flags the placeholder operand inside the AVX-512 min/max intrinsics as uninitialised
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#endif
+#include <immintrin.h>
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+namespace {
+
+// Child boxes and ray values as handed to the slab tests
+struct slab_input {
+    const double* min[3];
+    const double* max[3];
+    double origin[3];
+    double inv_direction[3];
+    double t_min;
+    double t_max;
+};
+
+#if defined(__AVX512F__)
+// Tests 8 children at once
+inline int slab_test_8(const slab_input& in, int base, double* t_near) {
+    __m512d t_enter = _mm512_set1_pd(in.t_min);
+    __m512d t_exit = _mm512_set1_pd(in.t_max);
+
+    for (int a = 0; a < 3; a++) {
+        const __m512d origin = _mm512_set1_pd(in.origin[a]);
+        const __m512d inv = _mm512_set1_pd(in.inv_direction[a]);
+        const __m512d t0 = _mm512_mul_pd(_mm512_sub_pd(_mm512_loadu_pd(in.min[a] + base), origin), inv);
+        const __m512d t1 = _mm512_mul_pd(_mm512_sub_pd(_mm512_loadu_pd(in.max[a] + base), origin), inv);
+        t_enter = _mm512_max_pd(t_enter, _mm512_min_pd(t0, t1));
+        t_exit = _mm512_min_pd(t_exit, _mm512_max_pd(t0, t1));
+    }
+
+    _mm512_storeu_pd(t_near + base, t_enter);
+    return static_cast<int>(_mm512_cmp_pd_mask(t_enter, t_exit, _CMP_LE_OQ));
+}
+#endif
+
+#if defined(__AVX__)
+// Tests 4 children at once
+inline int slab_test_4(const slab_input& in, int base, double* t_near) {
+    __m256d t_enter = _mm256_set1_pd(in.t_min);
+    __m256d t_exit = _mm256_set1_pd(in.t_max);
+
+    for (int a = 0; a < 3; a++) {
+        const __m256d origin = _mm256_set1_pd(in.origin[a]);
+        const __m256d inv = _mm256_set1_pd(in.inv_direction[a]);
+        const __m256d t0 = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(in.min[a] + base), origin), inv);
+        const __m256d t1 = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(in.max[a] + base), origin), inv);
+        t_enter = _mm256_max_pd(t_enter, _mm256_min_pd(t0, t1));
+        t_exit = _mm256_min_pd(t_exit, _mm256_max_pd(t0, t1));
+    }
+
+    _mm256_storeu_pd(t_near + base, t_enter);
+    return _mm256_movemask_pd(_mm256_cmp_pd(t_enter, t_exit, _CMP_LE_OQ));
+}
+#endif
+
+#if defined(__SSE2__)
+// Tests 2 children at once
+inline int slab_test_2(const slab_input& in, int base, double* t_near) {
+    __m128d t_enter = _mm_set1_pd(in.t_min);
+    __m128d t_exit = _mm_set1_pd(in.t_max);
+
+    for (int a = 0; a < 3; a++) {
+        const __m128d origin = _mm_set1_pd(in.origin[a]);
+        const __m128d inv = _mm_set1_pd(in.inv_direction[a]);
+        const __m128d t0 = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(in.min[a] + base), origin), inv);
+        const __m128d t1 = _mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(in.max[a] + base), origin), inv);
+        t_enter = _mm_max_pd(t_enter, _mm_min_pd(t0, t1));
+        t_exit = _mm_min_pd(t_exit, _mm_max_pd(t0, t1));
+    }
+
+    _mm_storeu_pd(t_near + base, t_enter);
+    return _mm_movemask_pd(_mm_cmple_pd(t_enter, t_exit));
+}
+#endif
+
+// Portable fallback, one child at a time
+inline int slab_test_1(const slab_input& in, int base, double* t_near) {
+    double t_enter = in.t_min;
+    double t_exit = in.t_max;
+
+    for (int a = 0; a < 3; a++) {
+        const double t0 = (in.min[a][base] - in.origin[a]) * in.inv_direction[a];
+        const double t1 = (in.max[a][base] - in.origin[a]) * in.inv_direction[a];
+        t_enter = std::max(t_enter, std::min(t0, t1));
+        t_exit = std::min(t_exit, std::max(t0, t1));
+    }
+
+    t_near[base] = t_enter;
+    return t_enter <= t_exit ? 1 : 0;
+}
+
+// A pending piece of work on the traversal stack
+struct traversal_entry {
+    uint32_t index;
+    // Primitive count when this is a leaf, 0 for a node
+    uint16_t count;
+    double t;
+};
+
+// The same for packets, along with the rays that reached the entry
+struct packet_entry {
+    uint32_t index;
+    uint16_t count;
+    packet_mask mask;
+    double t;
+};
+
+}
+
+template<int N>
+void wide_bvh_node<N>::set_box(int slot, const aabb& box) {
+    min_x[slot] = box.minimum.x();
+    min_y[slot] = box.minimum.y();
+    min_z[slot] = box.minimum.z();
+    max_x[slot] = box.maximum.x();
+    max_y[slot] = box.maximum.y();
+    max_z[slot] = box.maximum.z();
+}
+
+template<int N>
+aabb wide_bvh_node<N>::box(int slot) const {
+    return aabb(point3(min_x[slot], min_y[slot], min_z[slot]), point3(max_x[slot], max_y[slot], max_z[slot]));
+}
+
+template<int N>
+wide_bvh<N>::wide_bvh(const linear_bvh& binary) : primitives(binary.primitives) {
+    if (binary.nodes.empty()) {
+        return;
+    }
+
+    bounds = binary.nodes[0].box;
+    nodes.reserve(binary.nodes.size() / 2 + 1);
+
+    if (binary.nodes[0].is_leaf()) {
+        // A single leaf still needs a node above it
+        nodes.emplace_back();
+        nodes[0].set_box(0, binary.nodes[0].box);
+        nodes[0].child[0] = binary.nodes[0].offset;
+        nodes[0].count[0] = binary.nodes[0].count;
+        nodes[0].child_mask = 1;
+        return;
+    }
+
+    collapse(binary, 0);
+}
+
+template<int N>
+uint32_t wide_bvh<N>::collapse(const linear_bvh& binary, uint32_t binary_index) {
+    // Start with the two binary children and keep opening the interior child
+    // with the largest surface area until the node is full
+    std::array<uint32_t, N> children;
+    int child_count = 2;
+    children[0] = binary_index + 1;
+    children[1] = binary.nodes[binary_index].offset;
+
+    while (child_count < N) {
+        int largest = -1;
+        double largest_area = -1;
+
+        for (int i = 0; i < child_count; i++) {
+            const auto& child = binary.nodes[children[i]];
+            if (!child.is_leaf() && child.box.surface_area() > largest_area) {
+                largest = i;
+                largest_area = child.box.surface_area();
+            }
+        }
+
+        if (largest < 0) {
+            break;
+        }
+
+        const uint32_t opened = children[largest];
+        children[largest] = opened + 1;
+        children[child_count++] = binary.nodes[opened].offset;
+    }
+
+    const auto node_index = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+
+    for (int slot = 0; slot < child_count; slot++) {
+        const auto& child = binary.nodes[children[slot]];
+
+        // Collapse first, the recursion can reallocate nodes
+        const uint32_t target = child.is_leaf() ? child.offset : collapse(binary, children[slot]);
+
+        auto& node = nodes[node_index];
+        node.set_box(slot, child.box);
+        node.child[slot] = target;
+        node.count[slot] = child.count;
+        node.child_mask |= 1 << slot;
+    }
+
+    return node_index;
+}
+
+template<int N>
+int wide_bvh<N>::intersect_children(const wide_bvh_node<N>& node, const point3& origin, const vec3& inv_direction,
+    double t_min, double t_max, double* t_near) const {
+
+    const slab_input in = {
+        { node.min_x.data(), node.min_y.data(), node.min_z.data() },
+        { node.max_x.data(), node.max_y.data(), node.max_z.data() },
+        { origin[0], origin[1], origin[2] },
+        { inv_direction[0], inv_direction[1], inv_direction[2] },
+        t_min, t_max
+    };
+
+    int mask = 0;
+
+#if defined(__AVX512F__)
+    if constexpr (N == 8) {
+        mask = slab_test_8(in, 0, t_near);
+    }
+    else {
+        mask = slab_test_4(in, 0, t_near);
+    }
+#elif defined(__AVX__)
+    for (int base = 0; base < N; base += 4) {
+        mask |= slab_test_4(in, base, t_near) << base;
+    }
+#elif defined(__SSE2__)
+    for (int base = 0; base < N; base += 2) {
+        mask |= slab_test_2(in, base, t_near) << base;
+    }
+#else
+    for (int base = 0; base < N; base++) {
+        mask |= slab_test_1(in, base, t_near) << base;
+    }
+#endif
+
+    return mask & node.child_mask;
+}
+
+template<int N>
+bool wide_bvh<N>::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    if (nodes.empty()) {
+        return false;
+    }
+
+    std::array<traversal_entry, N * bvh_max_depth> stack;
+    int stack_size = 0;
+    stack[stack_size++] = { 0, 0, t_min };
+
+    bool hit_anything = false;
+    double closest_so_far = t_max;
+
+    while (stack_size > 0) {
+        const traversal_entry entry = stack[--stack_size];
+
+        // Something closer was found after this entry was pushed
+        if (entry.t > closest_so_far) {
+            continue;
+        }
+
+        if (entry.count > 0) {
+            if constexpr (enable_traversal_stats) {
+                thread_traversal_stats().primitive_tests += entry.count;
+            }
+            for (uint32_t i = entry.index; i < entry.index + entry.count; i++) {
+                if (primitives[i]->hit(r, t_min, closest_so_far, rec)) {
+                    hit_anything = true;
+                    closest_so_far = rec.t;
+                }
+            }
+            continue;
+        }
+
+        const auto& node = nodes[entry.index];
+        alignas(64) double t_near[N];
+        int mask = intersect_children(node, r.origin, r.inv_direction, t_min, closest_so_far, t_near);
+
+        if constexpr (enable_traversal_stats) {
+            auto& counters = thread_traversal_stats();
+            counters.nodes_visited++;
+            counters.box_tests += std::popcount(node.child_mask);
+        }
+
+        // Push the children farthest first so the nearest one is popped next
+        std::array<traversal_entry, N> hits;
+        int hit_count = 0;
+        while (mask) {
+            const int slot = std::countr_zero(static_cast<unsigned>(mask));
+            mask &= mask - 1;
+
+            traversal_entry child = { node.child[slot], node.count[slot], t_near[slot] };
+            int i = hit_count++;
+            while (i > 0 && hits[i - 1].t < child.t) {
+                hits[i] = hits[i - 1];
+                i--;
+            }
+            hits[i] = child;
+        }
+
+        for (int i = 0; i < hit_count; i++) {
+            stack[stack_size++] = hits[i];
+        }
+
+        if constexpr (enable_traversal_stats) {
+            auto& counters = thread_traversal_stats();
+            counters.max_depth = std::max(counters.max_depth, stack_size);
+        }
+    }
+
+    return hit_anything;
+}
+
+template<int N>
+bool wide_bvh<N>::occluded(const ray& r, double t_min, double t_max) const {
+    if (nodes.empty()) {
+        return false;
+    }
+
+    // Any hit ends the search, so children are pushed without sorting them
+    std::array<traversal_entry, N * bvh_max_depth> stack;
+    int stack_size = 0;
+    stack[stack_size++] = { 0, 0, t_min };
+
+    while (stack_size > 0) {
+        const traversal_entry entry = stack[--stack_size];
+
+        if (entry.count > 0) {
+            if constexpr (enable_traversal_stats) {
+                thread_traversal_stats().primitive_tests += entry.count;
+            }
+            for (uint32_t i = entry.index; i < entry.index + entry.count; i++) {
+                if (primitives[i]->occluded(r, t_min, t_max)) {
+                    return true;
+                }
+            }
+            continue;
+        }
+
+        const auto& node = nodes[entry.index];
+        alignas(64) double t_near[N];
+        int mask = intersect_children(node, r.origin, r.inv_direction, t_min, t_max, t_near);
+
+        if constexpr (enable_traversal_stats) {
+            auto& counters = thread_traversal_stats();
+            counters.nodes_visited++;
+            counters.box_tests += std::popcount(node.child_mask);
+        }
+
+        while (mask) {
+            const int slot = std::countr_zero(static_cast<unsigned>(mask));
+            mask &= mask - 1;
+            stack[stack_size++] = { node.child[slot], node.count[slot], t_near[slot] };
+        }
+    }
+
+    return false;
+}
+
+template<int N>
+packet_mask wide_bvh<N>::hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const {
+    if (nodes.empty() || !active) {
+        return 0;
+    }
+
+    std::array<packet_entry, N * bvh_max_depth> stack;
+    int stack_size = 0;
+    stack[stack_size++] = { 0, 0, active, t_min };
+
+    alignas(64) std::array<double, packet_size> t_enter;
+    packet_mask hit_mask = 0;
+
+    while (stack_size > 0) {
+        const packet_entry entry = stack[--stack_size];
+
+        if (entry.count > 0) {
+            for (uint32_t i = entry.index; i < entry.index + entry.count; i++) {
+                hit_mask |= primitives[i]->hit_packet(packet, t_min, hits, entry.mask);
+            }
+            continue;
+        }
+
+        // Each child is tested against all rays at once rather than each ray
+        // against all children, and is ordered by the nearest ray to enter it
+        const auto& node = nodes[entry.index];
+        std::array<packet_entry, N> children;
+        int child_count = 0;
+
+        for (int slot = 0; slot < N; slot++) {
+            if (!(node.child_mask >> slot & 1)) {
+                continue;
+            }
+
+            const packet_mask mask = node.box(slot).hit(packet, t_min, hits.t_max, entry.mask, t_enter);
+            if (!mask) {
+                continue;
+            }
+
+            double nearest = infinity;
+            for (packet_mask m = mask; m; m &= m - 1) {
+                nearest = fmin(nearest, t_enter[std::countr_zero(m)]);
+            }
+
+            packet_entry child = { node.child[slot], node.count[slot], mask, nearest };
+            int i = child_count++;
+            while (i > 0 && children[i - 1].t < child.t) {
+                children[i] = children[i - 1];
+                i--;
+            }
+            children[i] = child;
+        }
+
+        for (int i = 0; i < child_count; i++) {
+            stack[stack_size++] = children[i];
+        }
+    }
+
+    return hit_mask;
+}
+
+template<int N>
+bool wide_bvh<N>::bounding_box(aabb& output_box) const {
+    if (nodes.empty()) {
+        return false;
+    }
+
+    output_box = bounds;
+    return true;
+}
+
+template<int N>
+bool wide_bvh<N>::random_hit() const {
+    return std::any_of(primitives.begin(), primitives.end(), [](const auto& object) { return object->random_hit(); });
+}
+
+const char* to_string(bvh_layout layout) {
+    switch (layout) {
+        case bvh_layout::binary: return "binary";
+        case bvh_layout::bvh4: return "bvh4";
+        case bvh_layout::bvh8: return "bvh8";
+    }
+    return "unknown";
+}
+
+std::shared_ptr<hittable> with_layout(const std::shared_ptr<linear_bvh>& binary, bvh_layout layout) {
+    switch (layout) {
+        case bvh_layout::bvh4: return std::make_shared<bvh4>(*binary);
+        case bvh_layout::bvh8: return std::make_shared<bvh8>(*binary);
+        default: return binary;
+    }
+}
+
+template struct wide_bvh_node<4>;
+template struct wide_bvh_node<8>;
+template class wide_bvh<4>;
+template class wide_bvh<8>;
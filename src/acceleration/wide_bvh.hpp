@@ -0,0 +1,82 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <array>
+#include <cstdint>
+
+#include "acceleration/aabb.hpp"
+#include "acceleration/linear_bvh.hpp"
+#include "scene/hittable.hpp"
+#include "utils/util.hpp"
+
+
+// A node with up to N children. The child boxes are stored as structure of
+// arrays so a single SIMD slab test can check all of them against a ray.
+template<int N>
+struct alignas(64) wide_bvh_node {
+    std::array<double, N> min_x, min_y, min_z;
+    std::array<double, N> max_x, max_y, max_z;
+    // Interior children: index of the child node
+    // Leaf children: index of the first primitive
+    std::array<uint32_t, N> child;
+    // Number of primitives for leaf children, 0 for interior children
+    std::array<uint16_t, N> count;
+    // One bit per slot that holds a child
+    uint8_t child_mask = 0;
+
+    void set_box(int slot, const aabb& box);
+    aabb box(int slot) const;
+};
+
+
+// A bvh collapsed from a binary linear_bvh so every node holds up to N
+// children. Children are visited nearest first.
+template<int N>
+class wide_bvh : public hittable {
+    static_assert(N == 4 || N == 8, "wide_bvh supports 4 and 8 wide nodes");
+
+public:
+    wide_bvh() = default;
+
+    wide_bvh(const linear_bvh& binary);
+
+    virtual bool hit(
+        const ray& r, double t_min, double t_max, hit_record& rec) const override;
+
+    virtual packet_mask hit_packet(
+        const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const override;
+
+    virtual bool bounding_box(aabb& output_box) const override;
+
+    virtual bool random_hit() const override;
+
+    virtual bool occluded(const ray& r, double t_min, double t_max) const override;
+
+private:
+    uint32_t collapse(const linear_bvh& binary, uint32_t binary_index);
+
+    // Returns a bit mask of the children hit and writes their entry distances
+    int intersect_children(const wide_bvh_node<N>& node, const point3& origin, const vec3& inv_direction,
+        double t_min, double t_max, double* t_near) const;
+
+public:
+    std::vector<wide_bvh_node<N>> nodes;
+    std::vector<std::shared_ptr<hittable>> primitives;
+    aabb bounds;
+};
+
+using bvh4 = wide_bvh<4>;
+using bvh8 = wide_bvh<8>;
+
+// Which node layout a scene is traced with
+enum class bvh_layout {
+    binary,
+    bvh4,
+    bvh8
+};
+
+const char* to_string(bvh_layout layout);
+
+// Returns the binary bvh as is or collapsed into the requested wide layout
+std::shared_ptr<hittable> with_layout(const std::shared_ptr<linear_bvh>& binary, bvh_layout layout);
@@ -37,6 +37,11 @@ public:
 		lens_radius = aperture / 2;
 	}
 
+	// True when there's no depth of field and every ray leaves from the same point
+	bool is_pinhole() const {
+		return lens_radius == 0;
+	}
+
 	ray get_ray(const double s, const double t) const {
 		vec3 rd = lens_radius * random_in_unit_disk();
 		vec3 offset = u * rd.x() + v * rd.y();
@@ -14,4 +14,8 @@ std::tuple<uint8_t, uint8_t, uint8_t> get_normalized_color(const color& pixel_co
 		static_cast<uint8_t>(256 * clamp(r, 0, .999)),
 		static_cast<uint8_t>(256 * clamp(g, 0, .999)),
 		static_cast<uint8_t>(256 * clamp(b, 0, .999)));
-}
\ No newline at end of file
+}
+
+double luminance(const color& c) {
+	return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
@@ -5,4 +5,7 @@
 
 #include "core/vec3.hpp"
 
-std::tuple<uint8_t, uint8_t, uint8_t> get_normalized_color(const color& pixel_color, const int samples_per_pixel);
\ No newline at end of file
+std::tuple<uint8_t, uint8_t, uint8_t> get_normalized_color(const color& pixel_color, const int samples_per_pixel);
+
+// Perceived brightness of a linear color, Rec. 709 weights
+double luminance(const color& c);
@@ -1,13 +1,22 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
+
 #include "core/vec3.hpp"
 
 struct ray {
 	point3 origin;
 	vec3 direction;
+	// Cached for slab tests so boxes never divide by the direction
+	vec3 inv_direction;
+	// 1 where the direction is negative, picks the near and far box planes
+	std::array<uint8_t, 3> sign = {0, 0, 0};
 
 	ray() = default;
-	ray(const point3& o, const vec3& d) : origin(o), direction(d) {}
+	ray(const point3& o, const vec3& d) : origin(o), direction(d),
+		inv_direction(1.0 / d[0], 1.0 / d[1], 1.0 / d[2]),
+		sign{inv_direction[0] < 0, inv_direction[1] < 0, inv_direction[2] < 0} {}
 
 	point3 at(const double t) const {
 		return origin + (t * direction);
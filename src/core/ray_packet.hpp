@@ -0,0 +1,42 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "core/ray.hpp"
+
+// Rays traced together, 4, 8 or 16 all work
+constexpr int packet_size = 8;
+
+// One bit per ray of a packet
+using packet_mask = uint32_t;
+
+static_assert(packet_size < 32, "packet_mask needs a bit for every ray");
+
+// A group of coherent rays, kept both as plain rays for the primitives that
+// only trace one ray at a time and as structure of arrays so boxes and simple
+// primitives can be tested against every ray of the packet at once.
+struct ray_packet {
+	std::array<ray, packet_size> rays;
+	// Unused lanes stay zeroed so whole-packet loops never read garbage
+	alignas(64) std::array<double, packet_size> origin[3] = {};
+	alignas(64) std::array<double, packet_size> direction[3] = {};
+	alignas(64) std::array<double, packet_size> inv_direction[3] = {};
+	int count = 0;
+
+	ray_packet() = default;
+
+	void add(const ray& r) {
+		for (int a = 0; a < 3; a++) {
+			origin[a][count] = r.origin[a];
+			direction[a][count] = r.direction[a];
+			inv_direction[a][count] = r.inv_direction[a];
+		}
+		rays[count++] = r;
+	}
+
+	// Mask with a bit set for every ray that was added
+	packet_mask active() const {
+		return (packet_mask(1) << count) - 1;
+	}
+};
@@ -0,0 +1,94 @@
+#include "core/transform.hpp"
+
+static constexpr transform::matrix identity = {{
+	{ 1, 0, 0, 0 },
+	{ 0, 1, 0, 0 },
+	{ 0, 0, 1, 0 }
+}};
+
+transform::transform() : m(identity), inv(identity) {}
+
+transform transform::translation(const vec3& offset) {
+	matrix forward = identity;
+	matrix backward = identity;
+	for(int i = 0; i < 3; i++) {
+		forward[i][3] = offset[i];
+		backward[i][3] = -offset[i];
+	}
+	return transform(forward, backward);
+}
+
+transform transform::scaling(const vec3& factors) {
+	matrix forward = identity;
+	matrix backward = identity;
+	for(int i = 0; i < 3; i++) {
+		forward[i][i] = factors[i];
+		backward[i][i] = 1.0 / factors[i];
+	}
+	return transform(forward, backward);
+}
+
+transform transform::rotation(const vec3& axis, const double degrees) {
+	const vec3 a = unit_vector(axis);
+	const double radians = degrees_to_radians(degrees);
+	const double s = sin(radians);
+	const double c = cos(radians);
+	const double t = 1 - c;
+
+	// Rodrigues' rotation formula
+	const matrix forward = {{
+		{ t * a.x() * a.x() + c, t * a.x() * a.y() - s * a.z(), t * a.x() * a.z() + s * a.y(), 0 },
+		{ t * a.x() * a.y() + s * a.z(), t * a.y() * a.y() + c, t * a.y() * a.z() - s * a.x(), 0 },
+		{ t * a.x() * a.z() - s * a.y(), t * a.y() * a.z() + s * a.x(), t * a.z() * a.z() + c, 0 }
+	}};
+
+	// A rotation's inverse is its transpose
+	matrix backward = identity;
+	for(int i = 0; i < 3; i++) {
+		for(int j = 0; j < 3; j++) {
+			backward[i][j] = forward[j][i];
+		}
+	}
+
+	return transform(forward, backward);
+}
+
+transform::matrix transform::multiply(const matrix& a, const matrix& b) {
+	matrix result;
+	for(int i = 0; i < 3; i++) {
+		for(int j = 0; j < 4; j++) {
+			result[i][j] = a[i][0] * b[0][j] + a[i][1] * b[1][j] + a[i][2] * b[2][j];
+		}
+		result[i][3] += a[i][3];
+	}
+	return result;
+}
+
+transform transform::operator*(const transform& other) const {
+	// (A * B)^-1 = B^-1 * A^-1
+	return transform(multiply(m, other.m), multiply(other.inv, inv));
+}
+
+point3 transform::apply_point(const matrix& a, const point3& p) {
+	return point3(
+		a[0][0] * p[0] + a[0][1] * p[1] + a[0][2] * p[2] + a[0][3],
+		a[1][0] * p[0] + a[1][1] * p[1] + a[1][2] * p[2] + a[1][3],
+		a[2][0] * p[0] + a[2][1] * p[1] + a[2][2] * p[2] + a[2][3]
+	);
+}
+
+vec3 transform::apply_vector(const matrix& a, const vec3& v) {
+	return vec3(
+		a[0][0] * v[0] + a[0][1] * v[1] + a[0][2] * v[2],
+		a[1][0] * v[0] + a[1][1] * v[1] + a[1][2] * v[2],
+		a[2][0] * v[0] + a[2][1] * v[1] + a[2][2] * v[2]
+	);
+}
+
+vec3 transform::normal(const vec3& n) const {
+	return vec3(
+		inv[0][0] * n[0] + inv[1][0] * n[1] + inv[2][0] * n[2],
+		inv[0][1] * n[0] + inv[1][1] * n[1] + inv[2][1] * n[2],
+		inv[0][2] * n[0] + inv[1][2] * n[1] + inv[2][2] * n[2]
+	);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+
+#include "core/vec3.hpp"
+
+// An affine transform stored as the top three rows of a 4x4 matrix along with
+// its inverse, so neither direction ever needs a matrix inversion.
+class transform {
+public:
+	using matrix = std::array<std::array<double, 4>, 3>;
+
+	// Identity
+	transform();
+
+	static transform translation(const vec3& offset);
+	static transform scaling(const vec3& factors);
+	// Rotation by an angle in degrees around an axis through the origin
+	static transform rotation(const vec3& axis, const double degrees);
+	static transform rotation_y(const double degrees) { return rotation(vec3(0, 1, 0), degrees); }
+
+	// Applies other first, then this
+	transform operator*(const transform& other) const;
+
+	transform inverse() const { return transform(inv, m); }
+
+	point3 point(const point3& p) const { return apply_point(m, p); }
+	vec3 vector(const vec3& v) const { return apply_vector(m, v); }
+	// Normals go through the inverse transpose so they stay perpendicular under non uniform scaling
+	vec3 normal(const vec3& n) const;
+
+	// The other way round, without building the inverse transform first
+	point3 inverse_point(const point3& p) const { return apply_point(inv, p); }
+	vec3 inverse_vector(const vec3& v) const { return apply_vector(inv, v); }
+
+private:
+	transform(const matrix& forward, const matrix& backward) : m(forward), inv(backward) {}
+
+	static matrix multiply(const matrix& a, const matrix& b);
+	static point3 apply_point(const matrix& a, const point3& p);
+	static vec3 apply_vector(const matrix& a, const vec3& v);
+
+	matrix m;
+	matrix inv;
+};
@@ -16,16 +16,18 @@ vec3 unit_vector(const vec3& v) {
 	return v / v.length();
 }
 
+// These map uniform numbers straight to points instead of rejecting some, so
+// every call takes the same numbers and stratified samples stay stratified
 vec3 random_in_unit_sphere() {
-	while(true) {
-		auto p = vec3::random(-1, 1);
-		if(p.length_squared() >= 1) continue;
-		return p;
-	}
+	return random_unit_vector() * std::cbrt(random_double());
 }
 
 vec3 random_unit_vector() {
-	return unit_vector(random_in_unit_sphere());
+	const auto [u, v] = random_double_2d();
+	const double z = 1 - 2 * u;
+	const double r = std::sqrt(std::max(0.0, 1 - z * z));
+	const double phi = 2 * std::numbers::pi * v;
+	return vec3(r * std::cos(phi), r * std::sin(phi), z);
 }
 
 vec3 random_in_hemisphere(const vec3& normal) {
@@ -37,11 +39,10 @@ vec3 random_in_hemisphere(const vec3& normal) {
 }
 
 vec3 random_in_unit_disk() {
-	while(true) {
-		auto p = vec3(random_double(-1, 1), random_double(-1, 1), 0);
-		if(p.length_squared() >= 1) continue;
-		return p;
-	}
+	const auto [u, v] = random_double_2d();
+	const double r = std::sqrt(u);
+	const double theta = 2 * std::numbers::pi * v;
+	return vec3(r * std::cos(theta), r * std::sin(theta), 0);
 }
 
 vec3 reflect(const vec3& v, const vec3& n) {
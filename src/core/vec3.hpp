@@ -36,9 +36,9 @@ struct vec3 {
 	}
 
 	vec3& operator*=(const double t) {
-		e[0] += t;
-		e[1] += t;
-		e[2] += t;
+		e[0] *= t;
+		e[1] *= t;
+		e[2] *= t;
 		return *this;
 	}
 
@@ -1,5 +1,51 @@
 #include "geometry/aa_rect.hpp"
 
+namespace {
+
+// Packet test shared by the three orientations. The rect lies in the plane
+// where axis K equals k and spans [a0, a1] along axis A and [b0, b1] along axis B.
+template<int K, int A, int B>
+packet_mask hit_rect_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active,
+	double a0, double a1, double b0, double b1, double k, const vec3& outward_normal, const std::shared_ptr<material>& mat_ptr, const hittable* object) {
+
+	alignas(64) std::array<double, packet_size> ts;
+	packet_mask hit_mask = 0;
+	for (int i = 0; i < packet_size; i++) {
+		const double t = (k - packet.origin[K][i]) * packet.inv_direction[K][i];
+		const double a = packet.origin[A][i] + t * packet.direction[A][i];
+		const double b = packet.origin[B][i] + t * packet.direction[B][i];
+		ts[i] = t;
+		hit_mask |= packet_mask(t >= t_min && t <= hits.t_max[i] && a >= a0 && a <= a1 && b >= b0 && b <= b1) << i;
+	}
+
+	hit_mask &= active;
+	for (int i = 0; i < packet.count; i++) {
+		if (!(hit_mask >> i & 1)) continue;
+
+		hit_record& rec = hits.rec[i];
+		rec.t = ts[i];
+		rec.mat_ptr = mat_ptr;
+		rec.object = object;
+		rec.p = packet.rays[i].at(ts[i]);
+		rec.set_face_normal(packet.rays[i], outward_normal);
+
+		hits.t_max[i] = ts[i];
+	}
+
+	return hit_mask;
+}
+
+// Same plane and range test as hit, without the hit record
+template<int K, int A, int B>
+bool rect_occluded(const ray& r, const double t_min, const double t_max, double a0, double a1, double b0, double b1, double k) {
+	const double t = (k - r.origin[K]) * r.inv_direction[K];
+	const double a = r.origin[A] + t * r.direction[A];
+	const double b = r.origin[B] + t * r.direction[B];
+	return t >= t_min && t <= t_max && a >= a0 && a <= a1 && b >= b0 && b <= b1;
+}
+
+}
+
 bool xy_rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
 	// Check that the ray in in a valid range for a hit.
 	auto t = (k - r.origin.z()) / r.direction.z();
@@ -16,12 +62,27 @@ bool xy_rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) con
 
 	rec.t = t;
 	rec.mat_ptr = mat_ptr;
+	rec.object = this;
 	rec.p = r.at(t);
 	rec.set_face_normal(r, vec3(0, 0, 1));
 
 	return true;
 }
 
+packet_mask xy_rect::hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const {
+	return hit_rect_packet<2, 0, 1>(packet, t_min, hits, active, x0, x1, y0, y1, k, vec3(0, 0, 1), mat_ptr, this);
+}
+
+bool xy_rect::occluded(const ray& r, const double t_min, const double t_max) const {
+	return rect_occluded<2, 0, 1>(r, t_min, t_max, x0, x1, y0, y1, k);
+}
+
+void xy_rect::sample_surface(const point3& origin, point3& p, vec3& normal) const {
+	const auto [u, v] = random_double_2d();
+	p = point3(x0 + u * (x1 - x0), y0 + v * (y1 - y0), k);
+	normal = vec3(0, 0, 1);
+}
+
 bool xy_rect::bounding_box(aabb& output_box) const {
 	// The bounding box must have non-zero width in each dimension, so pad the Z
 	// dimension a small amount.
@@ -44,11 +105,26 @@ bool xz_rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) con
 	}
 	rec.t = t;
 	rec.mat_ptr = mat_ptr;
+	rec.object = this;
 	rec.p = r.at(t);
 	rec.set_face_normal(r, vec3(0, 1, 0));
 	return true;
 }
 
+packet_mask xz_rect::hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const {
+	return hit_rect_packet<1, 0, 2>(packet, t_min, hits, active, x0, x1, z0, z1, k, vec3(0, 1, 0), mat_ptr, this);
+}
+
+bool xz_rect::occluded(const ray& r, const double t_min, const double t_max) const {
+	return rect_occluded<1, 0, 2>(r, t_min, t_max, x0, x1, z0, z1, k);
+}
+
+void xz_rect::sample_surface(const point3& origin, point3& p, vec3& normal) const {
+	const auto [u, v] = random_double_2d();
+	p = point3(x0 + u * (x1 - x0), k, z0 + v * (z1 - z0));
+	normal = vec3(0, 1, 0);
+}
+
 bool xz_rect::bounding_box(aabb& output_box) const {
 	// The bounding box must have non-zero width in each dimension, so pad the Y
 	// dimension a small amount.
@@ -71,11 +147,26 @@ bool yz_rect::hit(const ray& r, double t_min, double t_max, hit_record& rec) con
 	}
 	rec.t = t;
 	rec.mat_ptr = mat_ptr;
+	rec.object = this;
 	rec.p = r.at(t);
 	rec.set_face_normal(r, vec3(1, 0, 0));
 	return true;
 }
 
+packet_mask yz_rect::hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const {
+	return hit_rect_packet<0, 1, 2>(packet, t_min, hits, active, y0, y1, z0, z1, k, vec3(1, 0, 0), mat_ptr, this);
+}
+
+bool yz_rect::occluded(const ray& r, const double t_min, const double t_max) const {
+	return rect_occluded<0, 1, 2>(r, t_min, t_max, y0, y1, z0, z1, k);
+}
+
+void yz_rect::sample_surface(const point3& origin, point3& p, vec3& normal) const {
+	const auto [u, v] = random_double_2d();
+	p = point3(k, y0 + u * (y1 - y0), z0 + v * (z1 - z0));
+	normal = vec3(1, 0, 0);
+}
+
 bool yz_rect::bounding_box(aabb& output_box) const {
 	// The bounding box must have non-zero width in each dimension, so pad the X
 	// dimension a small amount.
@@ -11,6 +11,15 @@ public:
 
 	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
 	virtual bool bounding_box(aabb& output_box) const override;
+	virtual packet_mask hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const override;
+	virtual bool occluded(const ray& r, const double t_min, const double t_max) const override;
+	virtual double surface_area() const override { return (x1 - x0) * (y1 - y0); }
+	virtual const material* surface_material() const override { return mat_ptr.get(); }
+	virtual void sample_surface(const point3& origin, point3& p, vec3& normal) const override;
+	virtual double surface_normal_bounds(vec3& axis) const override {
+		axis = vec3(0, 0, 1);
+		return 0;
+	}
 
 public:
 	double x0, x1, y0, y1, k;
@@ -25,6 +34,15 @@ public:
 
 	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
 	virtual bool bounding_box(aabb& output_box) const override;
+	virtual packet_mask hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const override;
+	virtual bool occluded(const ray& r, const double t_min, const double t_max) const override;
+	virtual double surface_area() const override { return (x1 - x0) * (z1 - z0); }
+	virtual const material* surface_material() const override { return mat_ptr.get(); }
+	virtual void sample_surface(const point3& origin, point3& p, vec3& normal) const override;
+	virtual double surface_normal_bounds(vec3& axis) const override {
+		axis = vec3(0, 1, 0);
+		return 0;
+	}
 
 public:
 	double x0, x1, z0, z1, k;
@@ -39,6 +57,15 @@ public:
 
 	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
 	virtual bool bounding_box(aabb& output_box) const override;
+	virtual packet_mask hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const override;
+	virtual bool occluded(const ray& r, const double t_min, const double t_max) const override;
+	virtual double surface_area() const override { return (y1 - y0) * (z1 - z0); }
+	virtual const material* surface_material() const override { return mat_ptr.get(); }
+	virtual void sample_surface(const point3& origin, point3& p, vec3& normal) const override;
+	virtual double surface_normal_bounds(vec3& axis) const override {
+		axis = vec3(1, 0, 0);
+		return 0;
+	}
 
 public:
 	double y0, y1, z0, z1, k;
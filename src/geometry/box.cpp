@@ -1,24 +1,113 @@
 #include "geometry/box.hpp"
 
-box::box(const point3& p0, const point3& p1, std::shared_ptr<material> ptr) {
-	box_min = p0;
-	box_max = p1;
+bool box::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+	// Same slab test as aabb, also keeping the axis of the planes that bound
+	// the interval because those are the faces the ray crosses
+	double t_near = -infinity;
+	double t_far = infinity;
+	int near_axis = 0;
+	int far_axis = 0;
+	for (int a = 0; a < 3; a++) {
+		const double near_plane = r.sign[a] ? box_max[a] : box_min[a];
+		const double far_plane = r.sign[a] ? box_min[a] : box_max[a];
+		const double t0 = (near_plane - r.origin[a]) * r.inv_direction[a];
+		const double t1 = (far_plane - r.origin[a]) * r.inv_direction[a];
+		if (t0 > t_near) {
+			t_near = t0;
+			near_axis = a;
+		}
+		if (t1 < t_far) {
+			t_far = t1;
+			far_axis = a;
+		}
+	}
+
+	if (t_near > t_far) {
+		return false;
+	}
 
-	sides.add(std::make_shared<xy_rect>(p0.x(), p1.x(), p0.y(), p1.y(), p1.z(), ptr));
-	sides.add(std::make_shared<xy_rect>(p0.x(), p1.x(), p0.y(), p1.y(), p0.z(), ptr));
+	// A ray that starts inside the box hits it on the way out
+	const bool entering = t_near >= t_min;
+	const double t = entering ? t_near : t_far;
+	if (t < t_min || t > t_max) {
+		return false;
+	}
 
-	sides.add(std::make_shared<xz_rect>(p0.x(), p1.x(), p0.z(), p1.z(), p1.y(), ptr));
-	sides.add(std::make_shared<xz_rect>(p0.x(), p1.x(), p0.z(), p1.z(), p0.y(), ptr));
+	const int axis = entering ? near_axis : far_axis;
+	rec.t = t;
+	rec.mat_ptr = mat_ptr;
+	rec.object = this;
+	rec.p = r.at(t);
+	rec.set_face_normal(r, box_face_normal(axis, r.sign[axis], entering));
 
-	sides.add(std::make_shared<yz_rect>(p0.y(), p1.y(), p0.z(), p1.z(), p1.x(), ptr));
-	sides.add(std::make_shared<yz_rect>(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), ptr));
+	return true;
 }
 
-bool box::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
-	return sides.hit(r, t_min, t_max, rec);
+packet_mask box::hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const {
+	// Solve every lane first, this loop has no branches and vectorises.
+	// The axis is carried as a double so every lane value is the same width.
+	alignas(64) std::array<double, packet_size> ts;
+	alignas(64) std::array<double, packet_size> axes;
+	packet_mask hit_mask = 0;
+	packet_mask entering_mask = 0;
+	for (int i = 0; i < packet_size; i++) {
+		double t_near = -infinity;
+		double t_far = infinity;
+		double near_axis = 0;
+		double far_axis = 0;
+		for (int a = 0; a < 3; a++) {
+			const double t0 = (box_min[a] - packet.origin[a][i]) * packet.inv_direction[a][i];
+			const double t1 = (box_max[a] - packet.origin[a][i]) * packet.inv_direction[a][i];
+			const double lower = fmin(t0, t1);
+			const double upper = fmax(t0, t1);
+			near_axis = lower > t_near ? a : near_axis;
+			far_axis = upper < t_far ? a : far_axis;
+			t_near = fmax(t_near, lower);
+			t_far = fmin(t_far, upper);
+		}
+
+		const bool entering = t_near >= t_min;
+		const double t = entering ? t_near : t_far;
+		ts[i] = t;
+		axes[i] = entering ? near_axis : far_axis;
+		hit_mask |= packet_mask(t_near <= t_far && t >= t_min && t <= hits.t_max[i]) << i;
+		entering_mask |= packet_mask(entering) << i;
+	}
+
+	hit_mask &= active;
+	for (int i = 0; i < packet.count; i++) {
+		if (!(hit_mask >> i & 1)) continue;
+
+		const ray& r = packet.rays[i];
+		const int axis = static_cast<int>(axes[i]);
+		hit_record& rec = hits.rec[i];
+		rec.t = ts[i];
+		rec.mat_ptr = mat_ptr;
+		rec.object = this;
+		rec.p = r.at(ts[i]);
+		rec.set_face_normal(r, box_face_normal(axis, r.sign[axis], entering_mask >> i & 1));
+
+		hits.t_max[i] = ts[i];
+	}
+
+	return hit_mask;
+}
+
+bool box::occluded(const ray& r, const double t_min, const double t_max) const {
+	double t_near = -infinity;
+	double t_far = infinity;
+	for (int a = 0; a < 3; a++) {
+		const double near_plane = r.sign[a] ? box_max[a] : box_min[a];
+		const double far_plane = r.sign[a] ? box_min[a] : box_max[a];
+		t_near = fmax(t_near, (near_plane - r.origin[a]) * r.inv_direction[a]);
+		t_far = fmin(t_far, (far_plane - r.origin[a]) * r.inv_direction[a]);
+	}
+
+	// The surface is crossed where the ray enters or where it leaves
+	return t_near <= t_far && ((t_near >= t_min && t_near <= t_max) || (t_far >= t_min && t_far <= t_max));
 }
 
 bool box::bounding_box(aabb& output_box) const {
 	output_box = aabb(box_min, box_max);
 	return true;
-}
\ No newline at end of file
+}
@@ -2,19 +2,31 @@
 
 #include "utils/util.hpp"
 
-#include "geometry/aa_rect.hpp"
-#include "scene/hittable_list.hpp"
+#include "scene/hittable.hpp"
 
+// An axis aligned box. One slab test finds both the distance and the face the
+// ray crosses, so the sides never have to be tested one by one.
 class box : public hittable {
 public:
 	box() = default;
-	box(const point3& p0, const point3& p1, std::shared_ptr<material> ptr);
+	box(const point3& p0, const point3& p1, std::shared_ptr<material> ptr)
+		: box_min(p0), box_max(p1), mat_ptr(ptr) {}
 
 	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
 	virtual bool bounding_box(aabb& output_box) const override;
+	virtual packet_mask hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const override;
+	virtual bool occluded(const ray& r, const double t_min, const double t_max) const override;
 
 public:
 	point3 box_min;
 	point3 box_max;
-	hittable_list sides;
-};
\ No newline at end of file
+	std::shared_ptr<material> mat_ptr;
+};
+
+// Normal of the face crossed along axis. Entering against a positive direction
+// or leaving along one crosses the face on the max side.
+inline vec3 box_face_normal(const int axis, const bool negative_direction, const bool entering) {
+	vec3 outward_normal(0, 0, 0);
+	outward_normal[axis] = negative_direction == entering ? 1 : -1;
+	return outward_normal;
+}
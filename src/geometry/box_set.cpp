@@ -0,0 +1,110 @@
+#include "geometry/box_set.hpp"
+
+#include <algorithm>
+
+#include "acceleration/bvh_traversal.hpp"
+
+box_set::box_set(const std::vector<box>& boxes) {
+	std::vector<aabb> bounds(boxes.size());
+	for (size_t i = 0; i < boxes.size(); i++) {
+		boxes[i].bounding_box(bounds[i]);
+	}
+
+	// Testing a full group costs about as much as testing a single box, so
+	// leaves are made as large as a group allows
+	bvh_build_options options;
+	options.max_leaf_size = box_group_size;
+	options.intersection_cost = 1.0 / box_group_size;
+
+	std::vector<uint32_t> order;
+	stats = bvh_builder(bounds, options).build(nodes, order);
+
+	groups.reserve(stats.leaf_count);
+	this->boxes.reserve(stats.leaf_count * box_group_size);
+	for (auto& node : nodes) {
+		if (!node.is_leaf()) {
+			continue;
+		}
+
+		box_group group;
+		for (int slot = 0; slot < box_group_size; slot++) {
+			const box& b = boxes[order[node.offset + std::min<int>(slot, node.count - 1)]];
+			group.set_box(slot, b.box_min, b.box_max);
+			this->boxes.push_back(b);
+		}
+
+		node.offset = static_cast<uint32_t>(groups.size());
+		groups.push_back(group);
+	}
+}
+
+bool box_set::bounding_box(aabb& output_box) const {
+	if (nodes.empty()) {
+		return false;
+	}
+
+	output_box = nodes[0].box;
+	return true;
+}
+
+int box_set::hit_group(const box_group& group, const ray& r, double t_min, double& t_max) const {
+	alignas(64) std::array<double, box_group_size> t_near;
+	alignas(64) std::array<double, box_group_size> t_far;
+	t_near.fill(-infinity);
+	t_far.fill(infinity);
+
+	// One axis at a time over every slot, the ray's sign picks the planes for
+	// the whole group so the inner loop is plain SIMD
+	for (int a = 0; a < 3; a++) {
+		const auto& near_planes = r.sign[a] ? group.maximum[a] : group.minimum[a];
+		const auto& far_planes = r.sign[a] ? group.minimum[a] : group.maximum[a];
+		for (int i = 0; i < box_group_size; i++) {
+			t_near[i] = fmax(t_near[i], (near_planes[i] - r.origin[a]) * r.inv_direction[a]);
+			t_far[i] = fmin(t_far[i], (far_planes[i] - r.origin[a]) * r.inv_direction[a]);
+		}
+	}
+
+	// A ray that starts inside a box hits it on the way out
+	alignas(64) std::array<double, box_group_size> t_hit;
+	for (int i = 0; i < box_group_size; i++) {
+		const double t = t_near[i] >= t_min ? t_near[i] : t_far[i];
+		t_hit[i] = t_near[i] <= t_far[i] && t >= t_min ? t : infinity;
+	}
+
+	int closest = -1;
+	for (int i = 0; i < box_group_size; i++) {
+		if (t_hit[i] < t_max) {
+			closest = i;
+			t_max = t_hit[i];
+		}
+	}
+
+	return closest;
+}
+
+bool box_set::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+	// Only the closest box fills in the hit record, once the traversal is done
+	size_t hit_slot = 0;
+	double closest_so_far = t_max;
+	const bool hit_anything = traverse_closest(nodes, r, t_min, closest_so_far, [&](const linear_bvh_node& node, double& t) {
+		if constexpr (enable_traversal_stats) {
+			thread_traversal_stats().primitive_tests++;
+		}
+		const int slot = hit_group(groups[node.offset], r, t_min, t);
+		if (slot < 0) {
+			return false;
+		}
+		hit_slot = static_cast<size_t>(node.offset) * box_group_size + slot;
+		return true;
+	});
+
+	// The group test only finds the distance, the box itself works out the face
+	return hit_anything && boxes[hit_slot].hit(r, t_min, t_max, rec);
+}
+
+bool box_set::occluded(const ray& r, const double t_min, const double t_max) const {
+	return traverse_any(nodes, r, t_min, t_max, [&](const linear_bvh_node& node) {
+		double t_hit = t_max;
+		return hit_group(groups[node.offset], r, t_min, t_hit) >= 0;
+	});
+}
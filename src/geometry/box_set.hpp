@@ -0,0 +1,52 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <array>
+
+#include "acceleration/bvh_builder.hpp"
+#include "geometry/box.hpp"
+#include "scene/hittable.hpp"
+
+// Up to box_group_size boxes stored as structure of arrays. Unused slots
+// repeat the last box, so tests always run over every slot and a ray that
+// hits a repeat has already hit the original.
+constexpr int box_group_size = 8;
+
+struct alignas(64) box_group {
+	std::array<double, box_group_size> minimum[3];
+	std::array<double, box_group_size> maximum[3];
+
+	void set_box(int slot, const point3& box_min, const point3& box_max) {
+		for (int a = 0; a < 3; a++) {
+			minimum[a][slot] = box_min[a];
+			maximum[a][slot] = box_max[a];
+		}
+	}
+};
+
+// Many axis aligned boxes behind a bvh of their own. Each leaf is one
+// box_group, so a ray tests a whole leaf with a single SIMD slab test
+// instead of one virtual hit per box.
+class box_set : public hittable {
+public:
+	box_set() = default;
+	box_set(const std::vector<box>& boxes);
+
+	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
+	virtual bool bounding_box(aabb& output_box) const override;
+	virtual bool occluded(const ray& r, const double t_min, const double t_max) const override;
+
+private:
+	// Finds the closest box of a group within the interval and lowers t_max to it.
+	// Returns the slot, or -1 when no box is hit.
+	int hit_group(const box_group& group, const ray& r, double t_min, double& t_max) const;
+
+public:
+	// Interior nodes as built, leaves point at their group instead of a primitive range
+	std::vector<linear_bvh_node> nodes;
+	std::vector<box_group> groups;
+	// Every slot of every group, for filling in the hit record of the closest one
+	std::vector<box> boxes;
+	bvh_build_stats stats;
+};
@@ -0,0 +1,473 @@
+#include "geometry/mesh_loader.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include "utils/mapped_file.hpp"
+
+namespace {
+
+// A read position in the text of a mapped file
+struct text_cursor {
+	const char* p;
+	const char* end;
+
+	bool done() const { return p >= end; }
+
+	void skip_blanks() {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+	}
+
+	// Blanks and line breaks alike
+	void skip_space() {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+	}
+
+	void skip_line() {
+		while (p < end && *p != '\n') p++;
+		if (p < end) p++;
+	}
+
+	// True at the end of the line or where a comment starts
+	bool at_line_end() {
+		skip_blanks();
+		return p >= end || *p == '\n' || *p == '#';
+	}
+
+	template<typename T>
+	bool read_number(T& value) {
+		if (p < end && *p == '+') p++;
+		auto [next, error] = std::from_chars(p, end, value);
+		if (error != std::errc()) {
+			return false;
+		}
+		p = next;
+		return true;
+	}
+
+	std::string_view read_word() {
+		skip_blanks();
+		const char* start = p;
+		while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+		return std::string_view(start, p - start);
+	}
+};
+
+// Vertex indices and list lengths have to be whole numbers that fit in 32 bits
+// before they are cast. Written so a NaN fails every comparison.
+bool is_index(const double value) {
+	return value >= 0 && value <= UINT32_MAX && value == std::floor(value);
+}
+
+// Every reader gathers its mesh in this form before handing it to triangle_mesh
+struct mesh_data {
+	std::array<std::vector<double>, 3> positions;
+	std::vector<uint32_t> indices;
+
+	size_t vertex_count() const { return positions[0].size(); }
+
+	void add_vertex(const double x, const double y, const double z) {
+		positions[0].push_back(x);
+		positions[1].push_back(y);
+		positions[2].push_back(z);
+	}
+
+	// Splits a face into a fan around its first corner
+	void add_face(const std::vector<uint32_t>& corners) {
+		for (size_t c = 1; c + 1 < corners.size(); c++) {
+			indices.push_back(corners[0]);
+			indices.push_back(corners[c]);
+			indices.push_back(corners[c + 1]);
+		}
+	}
+};
+
+std::shared_ptr<triangle_mesh> finish(mesh_data& data, const std::string& path, std::shared_ptr<material> mat,
+	const bvh_build_options& options, const std::chrono::high_resolution_clock::time_point start) {
+	const size_t vertex_count = data.vertex_count();
+	if (std::any_of(data.indices.begin(), data.indices.end(), [&](uint32_t index) { return index >= vertex_count; })) {
+		std::cerr << "Mesh " << path << " references a vertex it doesn't have.\n";
+		return nullptr;
+	}
+
+	auto parsed = std::chrono::high_resolution_clock::now();
+	auto mesh = std::make_shared<triangle_mesh>(std::move(data.positions), std::move(data.indices), mat, options);
+
+	std::cout << "Loaded " << path << ": " << mesh->vertex_count() << " vertices, " << mesh->triangle_count() << " triangles, parsed in "
+		<< std::chrono::duration<double, std::milli>(parsed - start).count() << "ms\n"
+		<< mesh->stats << std::endl;
+
+	return mesh;
+}
+
+enum class ply_format {
+	ascii,
+	binary_little_endian,
+	binary_big_endian
+};
+
+enum class ply_type {
+	int8,
+	uint8,
+	int16,
+	uint16,
+	int32,
+	uint32,
+	float32,
+	float64
+};
+
+bool parse_ply_type(const std::string_view name, ply_type& type) {
+	static constexpr std::pair<std::string_view, ply_type> names[] = {
+		{ "char", ply_type::int8 }, { "int8", ply_type::int8 },
+		{ "uchar", ply_type::uint8 }, { "uint8", ply_type::uint8 },
+		{ "short", ply_type::int16 }, { "int16", ply_type::int16 },
+		{ "ushort", ply_type::uint16 }, { "uint16", ply_type::uint16 },
+		{ "int", ply_type::int32 }, { "int32", ply_type::int32 },
+		{ "uint", ply_type::uint32 }, { "uint32", ply_type::uint32 },
+		{ "float", ply_type::float32 }, { "float32", ply_type::float32 },
+		{ "double", ply_type::float64 }, { "float64", ply_type::float64 }
+	};
+
+	for (const auto& [type_name, value] : names) {
+		if (type_name == name) {
+			type = value;
+			return true;
+		}
+	}
+	return false;
+}
+
+size_t ply_type_size(const ply_type type) {
+	switch (type) {
+		case ply_type::int8: case ply_type::uint8: return 1;
+		case ply_type::int16: case ply_type::uint16: return 2;
+		case ply_type::int32: case ply_type::uint32: case ply_type::float32: return 4;
+		case ply_type::float64: return 8;
+	}
+	return 0;
+}
+
+struct ply_property {
+	std::string_view name;
+	ply_type type;
+	// Lists store their length as count_type followed by that many values of type
+	bool is_list = false;
+	ply_type count_type = ply_type::uint8;
+};
+
+struct ply_element {
+	std::string_view name;
+	size_t count = 0;
+	std::vector<ply_property> properties;
+
+	int find(const std::string_view property_name) const {
+		for (size_t i = 0; i < properties.size(); i++) {
+			if (properties[i].name == property_name) {
+				return static_cast<int>(i);
+			}
+		}
+		return -1;
+	}
+};
+
+// Reads single values from the body in whichever format the header declared.
+// Running out of data sets failed instead of reading past the end.
+struct ply_reader {
+	text_cursor in;
+	ply_format format;
+	bool failed = false;
+
+	template<typename T>
+	double decode(const unsigned char* bytes) {
+		T value;
+		std::memcpy(&value, bytes, sizeof(T));
+		return static_cast<double>(value);
+	}
+
+	double read(const ply_type type) {
+		if (format == ply_format::ascii) {
+			double value = 0;
+			in.skip_space();
+			failed |= !in.read_number(value);
+			return value;
+		}
+
+		const size_t size = ply_type_size(type);
+		if (static_cast<size_t>(in.end - in.p) < size) {
+			failed = true;
+			return 0;
+		}
+
+		// Values in the other byte order are copied back to front
+		unsigned char bytes[8];
+		const bool little = format == ply_format::binary_little_endian;
+		const bool swap = little != (std::endian::native == std::endian::little);
+		for (size_t i = 0; i < size; i++) {
+			bytes[i] = static_cast<unsigned char>(in.p[swap ? size - 1 - i : i]);
+		}
+		in.p += size;
+
+		switch (type) {
+			case ply_type::int8: return decode<int8_t>(bytes);
+			case ply_type::uint8: return decode<uint8_t>(bytes);
+			case ply_type::int16: return decode<int16_t>(bytes);
+			case ply_type::uint16: return decode<uint16_t>(bytes);
+			case ply_type::int32: return decode<int32_t>(bytes);
+			case ply_type::uint32: return decode<uint32_t>(bytes);
+			case ply_type::float32: return decode<float>(bytes);
+			case ply_type::float64: return decode<double>(bytes);
+		}
+		return 0;
+	}
+
+	// Reads a property whose value isn't needed
+	void skip(const ply_property& property) {
+		if (!property.is_list) {
+			read(property.type);
+			return;
+		}
+		const auto count = static_cast<size_t>(read(property.count_type));
+		for (size_t i = 0; i < count && !failed; i++) {
+			read(property.type);
+		}
+	}
+};
+
+}
+
+std::shared_ptr<triangle_mesh> load_obj(const std::string& path, std::shared_ptr<material> mat, const bvh_build_options& options) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	mapped_file file(path);
+	if (!file.is_open()) {
+		std::cerr << "Could not open mesh " << path << ".\n";
+		return nullptr;
+	}
+
+	const auto text = file.contents();
+	text_cursor in{ text.data(), text.data() + text.size() };
+	mesh_data data;
+	std::vector<uint32_t> corners;
+
+	for (size_t line = 1; !in.done(); line++, in.skip_line()) {
+		in.skip_blanks();
+		if (in.end - in.p < 2 || (in.p[1] != ' ' && in.p[1] != '\t')) {
+			continue;
+		}
+
+		if (in.p[0] == 'v') {
+			in.p++;
+			double x, y, z;
+			in.skip_blanks();
+			bool ok = in.read_number(x);
+			in.skip_blanks();
+			ok = ok && in.read_number(y);
+			in.skip_blanks();
+			if (!ok || !in.read_number(z)) {
+				std::cerr << "Bad vertex on line " << line << " of " << path << ".\n";
+				return nullptr;
+			}
+			data.add_vertex(x, y, z);
+		}
+		else if (in.p[0] == 'f') {
+			in.p++;
+			corners.clear();
+			while (!in.at_line_end()) {
+				long long index;
+				if (!in.read_number(index)) {
+					std::cerr << "Bad face on line " << line << " of " << path << ".\n";
+					return nullptr;
+				}
+
+				// Texture and normal indices follow after slashes and aren't used
+				while (in.p < in.end && (*in.p == '/' || *in.p == '-' || (*in.p >= '0' && *in.p <= '9'))) in.p++;
+
+				// Negative indices count back from the last vertex so far
+				const long long resolved = index < 0 ? static_cast<long long>(data.vertex_count()) + index : index - 1;
+				if (!is_index(static_cast<double>(resolved))) {
+					std::cerr << "Bad vertex index on line " << line << " of " << path << ".\n";
+					return nullptr;
+				}
+				corners.push_back(static_cast<uint32_t>(resolved));
+			}
+			data.add_face(corners);
+		}
+	}
+
+	return finish(data, path, mat, options, start);
+}
+
+std::shared_ptr<triangle_mesh> load_ply(const std::string& path, std::shared_ptr<material> mat, const bvh_build_options& options) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	mapped_file file(path);
+	if (!file.is_open()) {
+		std::cerr << "Could not open mesh " << path << ".\n";
+		return nullptr;
+	}
+
+	const auto text = file.contents();
+	text_cursor in{ text.data(), text.data() + text.size() };
+	if (in.read_word() != "ply") {
+		std::cerr << path << " is not a PLY file.\n";
+		return nullptr;
+	}
+	in.skip_line();
+
+	// The header is plain text whatever format the body is in
+	ply_format format = ply_format::ascii;
+	std::vector<ply_element> elements;
+	bool header_done = false;
+	while (!in.done() && !header_done) {
+		const auto keyword = in.read_word();
+		bool ok = true;
+
+		if (keyword == "format") {
+			const auto name = in.read_word();
+			if (name == "ascii") format = ply_format::ascii;
+			else if (name == "binary_little_endian") format = ply_format::binary_little_endian;
+			else if (name == "binary_big_endian") format = ply_format::binary_big_endian;
+			else ok = false;
+		}
+		else if (keyword == "element") {
+			ply_element element;
+			element.name = in.read_word();
+			in.skip_blanks();
+			ok = in.read_number(element.count);
+			elements.push_back(element);
+		}
+		else if (keyword == "property") {
+			ply_property property;
+			auto type_name = in.read_word();
+			if (type_name == "list") {
+				property.is_list = true;
+				ok = parse_ply_type(in.read_word(), property.count_type);
+				type_name = in.read_word();
+			}
+			ok = ok && parse_ply_type(type_name, property.type) && !elements.empty();
+			property.name = in.read_word();
+			if (ok) {
+				elements.back().properties.push_back(property);
+			}
+		}
+		else if (keyword == "end_header") {
+			header_done = true;
+		}
+
+		if (!ok) {
+			std::cerr << "Bad PLY header in " << path << ".\n";
+			return nullptr;
+		}
+		in.skip_line();
+	}
+
+	if (!header_done) {
+		std::cerr << "PLY header of " << path << " never ends.\n";
+		return nullptr;
+	}
+
+	ply_reader reader{ in, format };
+	mesh_data data;
+	std::vector<uint32_t> corners;
+
+	for (const auto& element : elements) {
+		if (element.name == "vertex") {
+			const int x = element.find("x"), y = element.find("y"), z = element.find("z");
+			if (x < 0 || y < 0 || z < 0) {
+				std::cerr << "PLY vertices in " << path << " have no position.\n";
+				return nullptr;
+			}
+
+			std::array<double, 3> position = {};
+			for (size_t v = 0; v < element.count && !reader.failed; v++) {
+				for (int p = 0; p < static_cast<int>(element.properties.size()); p++) {
+					const auto& property = element.properties[p];
+					if (property.is_list) {
+						reader.skip(property);
+						continue;
+					}
+					const double value = reader.read(property.type);
+					position[0] = p == x ? value : position[0];
+					position[1] = p == y ? value : position[1];
+					position[2] = p == z ? value : position[2];
+				}
+				data.add_vertex(position[0], position[1], position[2]);
+			}
+		}
+		else if (element.name == "face") {
+			int list = element.find("vertex_indices");
+			if (list < 0) {
+				list = element.find("vertex_index");
+			}
+			if (list < 0 || !element.properties[list].is_list) {
+				std::cerr << "PLY faces in " << path << " have no vertex list.\n";
+				return nullptr;
+			}
+
+			for (size_t f = 0; f < element.count && !reader.failed; f++) {
+				for (int p = 0; p < static_cast<int>(element.properties.size()); p++) {
+					const auto& property = element.properties[p];
+					if (p != list) {
+						reader.skip(property);
+						continue;
+					}
+					const double corner_count = reader.read(property.count_type);
+					if (!is_index(corner_count)) {
+						std::cerr << "Bad vertex count in face " << f << " of " << path << ".\n";
+						return nullptr;
+					}
+					corners.resize(static_cast<size_t>(corner_count));
+					for (auto& corner : corners) {
+						const double index = reader.read(property.type);
+						if (!is_index(index)) {
+							std::cerr << "Bad vertex index in face " << f << " of " << path << ".\n";
+							return nullptr;
+						}
+						corner = static_cast<uint32_t>(index);
+					}
+				}
+				data.add_face(corners);
+			}
+		}
+		else {
+			for (size_t i = 0; i < element.count && !reader.failed; i++) {
+				for (const auto& property : element.properties) {
+					reader.skip(property);
+				}
+			}
+		}
+
+		if (reader.failed) {
+			std::cerr << "PLY file " << path << " ends before its " << element.name << " data does.\n";
+			return nullptr;
+		}
+	}
+
+	return finish(data, path, mat, options, start);
+}
+
+std::shared_ptr<triangle_mesh> load_mesh(const std::string& path, std::shared_ptr<material> mat, const bvh_build_options& options) {
+	const auto dot = path.find_last_of('.');
+	std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+	if (extension == "obj") {
+		return load_obj(path, mat, options);
+	}
+	if (extension == "ply") {
+		return load_ply(path, mat, options);
+	}
+
+	std::cerr << "Unknown mesh format for " << path << ", expected .obj or .ply.\n";
+	return nullptr;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "geometry/triangle_mesh.hpp"
+
+// Readers for triangle meshes stored as Wavefront OBJ or as PLY, either
+// ascii or binary. The file is memory mapped and parsed in place. Only vertex
+// positions and faces are read, faces with more than three corners are split
+// into fans. On failure the reason is printed and nullptr is returned.
+// The options are passed on to the mesh bvh, for example to cache it.
+std::shared_ptr<triangle_mesh> load_obj(const std::string& path, std::shared_ptr<material> mat, const bvh_build_options& options = {});
+std::shared_ptr<triangle_mesh> load_ply(const std::string& path, std::shared_ptr<material> mat, const bvh_build_options& options = {});
+
+// Picks the reader from the file extension
+std::shared_ptr<triangle_mesh> load_mesh(const std::string& path, std::shared_ptr<material> mat, const bvh_build_options& options = {});
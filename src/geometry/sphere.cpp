@@ -23,11 +23,144 @@ bool sphere::hit(const ray& r, const double t_min, const double t_max, hit_recor
 	vec3 outward_normal = (rec.p - center) / radius;
 	rec.set_face_normal(r, outward_normal);
 	rec.mat_ptr = mat_ptr;
+	rec.object = this;
 
 	return true;
 }
 
+packet_mask sphere::hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const {
+	// Solve for every lane first, this loop has no branches and vectorises
+	alignas(64) std::array<double, packet_size> roots;
+	packet_mask hit_mask = 0;
+	for (int i = 0; i < packet_size; i++) {
+		const double ox = packet.origin[0][i] - center.x();
+		const double oy = packet.origin[1][i] - center.y();
+		const double oz = packet.origin[2][i] - center.z();
+		const double dx = packet.direction[0][i];
+		const double dy = packet.direction[1][i];
+		const double dz = packet.direction[2][i];
+
+		const double a = dx * dx + dy * dy + dz * dz;
+		const double half_b = ox * dx + oy * dy + oz * dz;
+		const double c = ox * ox + oy * oy + oz * oz - (radius * radius);
+		const double discriminant = (half_b * half_b) - (a * c);
+		const double sqrtd = std::sqrt(fmax(discriminant, 0.0));
+
+		// Same root choice as the single ray test
+		const double near_root = (-half_b - sqrtd) / a;
+		const double far_root = (-half_b + sqrtd) / a;
+		roots[i] = near_root >= t_min ? near_root : far_root;
+		hit_mask |= packet_mask(discriminant >= 0 && roots[i] >= t_min && roots[i] <= hits.t_max[i]) << i;
+	}
+
+	hit_mask &= active;
+	for (int i = 0; i < packet.count; i++) {
+		if (!(hit_mask >> i & 1)) continue;
+
+		const ray& r = packet.rays[i];
+		hit_record& rec = hits.rec[i];
+		rec.t = roots[i];
+		rec.p = r.at(rec.t);
+		vec3 outward_normal = (rec.p - center) / radius;
+		rec.set_face_normal(r, outward_normal);
+		rec.mat_ptr = mat_ptr;
+		rec.object = this;
+
+		hits.t_max[i] = rec.t;
+	}
+
+	return hit_mask;
+}
+
+bool sphere::occluded(const ray& r, const double t_min, const double t_max) const {
+	vec3 oc = r.origin - center;
+	auto a = r.direction.length_squared();
+	auto half_b = dot(oc, r.direction);
+	auto c = oc.length_squared() - (radius * radius);
+
+	auto discriminant = (half_b * half_b) - (a * c);
+	if(discriminant < 0) return false;
+	auto sqrtd = std::sqrt(discriminant);
+
+	// Either root in range blocks the ray
+	auto near_root = (-half_b - sqrtd) / a;
+	auto far_root = (-half_b + sqrtd) / a;
+	return (near_root >= t_min && near_root <= t_max) || (far_root >= t_min && far_root <= t_max);
+}
+
 bool sphere::bounding_box(aabb& output_box) const {
 	output_box = aabb(center - vec3(radius, radius, radius), center + vec3(radius, radius, radius));
 	return true;
-}
\ No newline at end of file
+}
+
+bool sphere::clipped_box(const aabb& region, aabb& output_box) const {
+	bounding_box(output_box);
+	output_box.clip(region);
+
+	// A side of the region that misses the centre cuts the sphere down to the
+	// circle where that plane crosses it, which narrows the other two axes
+	for (int a = 0; a < 3 && !output_box.is_empty(); a++) {
+		const double d = fmax(fmax(output_box.minimum[a] - center[a], center[a] - output_box.maximum[a]), 0.0);
+		const double r = std::sqrt(fmax(radius * radius - d * d, 0.0));
+		for (int b = 0; b < 3; b++) {
+			if (b != a) {
+				output_box.minimum[b] = fmax(output_box.minimum[b], center[b] - r);
+				output_box.maximum[b] = fmin(output_box.maximum[b], center[b] + r);
+			}
+		}
+	}
+
+	return !output_box.is_empty();
+}
+
+namespace {
+
+// 1 - cos of the half angle of the cone a sphere takes up as seen from
+// distance_squared away, written as sin^2 / (1 + cos) so it keeps its
+// precision for small and distant spheres. 0 from inside the sphere.
+double one_minus_cos_cone(const double radius, const double distance_squared) {
+	const double sin_squared = radius * radius / distance_squared;
+	return sin_squared >= 1 ? 0 : sin_squared / (1 + std::sqrt(1 - sin_squared));
+}
+
+}
+
+void sphere::sample_surface(const point3& origin, point3& p, vec3& normal) const {
+	const vec3 to_center = center - origin;
+	const double distance_squared = to_center.length_squared();
+	const double one_minus_cos_max = one_minus_cos_cone(radius, distance_squared);
+
+	// From inside every point is in sight, so pick one by area
+	if (one_minus_cos_max <= 0) {
+		normal = random_unit_vector();
+		p = center + radius * normal;
+		return;
+	}
+
+	// A direction uniformly within the cone, then the point where it enters the sphere
+	const auto [u, v] = random_double_2d();
+	const double one_minus_cos = u * one_minus_cos_max;
+	const double cos_theta = 1 - one_minus_cos;
+	const double sin_theta = std::sqrt(std::max(0.0, one_minus_cos * (2 - one_minus_cos)));
+	const double phi = 2 * std::numbers::pi * v;
+
+	const double distance = std::sqrt(distance_squared);
+	const vec3 w = to_center / distance;
+	const vec3 s = unit_vector(cross(w, std::fabs(w.x()) > 0.9 ? vec3(0, 1, 0) : vec3(1, 0, 0)));
+	const vec3 t = cross(w, s);
+	const vec3 direction = (sin_theta * std::cos(phi)) * s + (sin_theta * std::sin(phi)) * t + cos_theta * w;
+
+	// Directions at the rim may pass just outside after rounding and graze the sphere
+	const double across = distance * sin_theta;
+	const double entry = distance * cos_theta - std::sqrt(std::max(0.0, radius * radius - across * across));
+	p = origin + entry * direction;
+	normal = unit_vector(p - center);
+}
+
+double sphere::surface_pdf(const point3& origin, const point3& p, const vec3& normal) const {
+	const double one_minus_cos_max = one_minus_cos_cone(radius, (center - origin).length_squared());
+	if (one_minus_cos_max <= 0) {
+		return hittable::surface_pdf(origin, p, normal);
+	}
+	return 1 / (2 * std::numbers::pi * one_minus_cos_max);
+}
@@ -13,4 +13,12 @@ struct sphere : public hittable {
 
 	virtual bool hit(const ray& r, const double t_min, const double t_max, hit_record& rec) const override;
 	virtual bool bounding_box(aabb& output_box) const override;
+	virtual packet_mask hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const override;
+	virtual bool clipped_box(const aabb& region, aabb& output_box) const override;
+	virtual bool occluded(const ray& r, const double t_min, const double t_max) const override;
+	virtual double surface_area() const override { return 4 * std::numbers::pi * radius * radius; }
+	virtual const material* surface_material() const override { return mat_ptr.get(); }
+	// Picks points on the cap of the sphere that origin sees
+	virtual void sample_surface(const point3& origin, point3& p, vec3& normal) const override;
+	virtual double surface_pdf(const point3& origin, const point3& p, const vec3& normal) const override;
 };
\ No newline at end of file
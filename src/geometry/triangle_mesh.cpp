@@ -0,0 +1,205 @@
+#include "geometry/triangle_mesh.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#include "acceleration/bvh_cache.hpp"
+#include "acceleration/bvh_traversal.hpp"
+
+triangle_mesh::triangle_mesh(std::array<std::vector<double>, 3> vertex_positions, std::vector<uint32_t> vertex_indices, std::shared_ptr<material> m,
+	const bvh_build_options& build_options)
+	: positions(std::move(vertex_positions)), indices(std::move(vertex_indices)), mat_ptr(m) {
+	// Testing a full group costs about as much as testing a single triangle,
+	// so leaves are made as large as a group allows
+	bvh_build_options options = build_options;
+	options.max_leaf_size = triangle_group_size;
+	options.intersection_cost = 1.0 / triangle_group_size;
+	options.spatial_splits = false;
+
+	const bool cached = !options.cache_directory.empty();
+	uint64_t key = 0;
+	if (cached) {
+		content_hash hash;
+		hash.add(options);
+		hash.add(sizeof(triangle_group));
+		hash.add(positions[0]);
+		hash.add(positions[1]);
+		hash.add(positions[2]);
+		hash.add(indices);
+		key = hash.value();
+
+		if (load_cached(options.cache_directory, key)) {
+			return;
+		}
+	}
+
+	build(options);
+
+	if (cached) {
+		write_bvh_cache(options.cache_directory, key,
+			{ bvh_cache_section::of(nodes), bvh_cache_section::of(groups), { &stats, sizeof(stats) } });
+	}
+}
+
+bool triangle_mesh::load_cached(const std::string& directory, const uint64_t key) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	const size_t count = triangle_count();
+	bvh_cache_file file(directory, key);
+	if (!file.valid() || !file.read(0, nodes) || !file.read(1, groups) || !file.read(2, stats) || nodes.empty()
+		|| std::any_of(groups.begin(), groups.end(), [&](const triangle_group& group) {
+			return std::any_of(group.triangle.begin(), group.triangle.end(), [&](uint32_t t) { return t >= count; });
+		})) {
+		nodes.clear();
+		groups.clear();
+		return false;
+	}
+
+	stats.from_cache = true;
+	stats.build_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return true;
+}
+
+void triangle_mesh::build(const bvh_build_options& options) {
+	const size_t count = triangle_count();
+
+	std::vector<aabb> bounds(count);
+	for (size_t t = 0; t < count; t++) {
+		aabb& box = bounds[t] = aabb::empty();
+		for (int c = 0; c < 3; c++) {
+			box.expand(vertex(indices[3 * t + c]));
+		}
+
+		// Triangles lying in an axis plane get the same padding as the rects,
+		// otherwise a leaf holding only those would have a box rays can't enter
+		for (int a = 0; a < 3; a++) {
+			if (box.maximum[a] - box.minimum[a] < 0.0001) {
+				box.minimum[a] -= 0.0001;
+				box.maximum[a] += 0.0001;
+			}
+		}
+	}
+
+	std::vector<uint32_t> order;
+	stats = bvh_builder(bounds, options).build(nodes, order);
+
+	groups.reserve(stats.leaf_count);
+	for (auto& node : nodes) {
+		if (!node.is_leaf()) {
+			continue;
+		}
+
+		triangle_group group;
+		for (int slot = 0; slot < triangle_group_size; slot++) {
+			const uint32_t t = order[node.offset + std::min<int>(slot, node.count - 1)];
+			const point3 v0 = vertex(indices[3 * t]);
+			const point3 v1 = vertex(indices[3 * t + 1]);
+			const point3 v2 = vertex(indices[3 * t + 2]);
+			for (int a = 0; a < 3; a++) {
+				group.corner[a][slot] = v0[a];
+				group.edge1[a][slot] = v1[a] - v0[a];
+				group.edge2[a][slot] = v2[a] - v0[a];
+			}
+			group.triangle[slot] = t;
+		}
+
+		node.offset = static_cast<uint32_t>(groups.size());
+		groups.push_back(group);
+	}
+}
+
+bool triangle_mesh::bounding_box(aabb& output_box) const {
+	if (nodes.empty()) {
+		return false;
+	}
+
+	output_box = nodes[0].box;
+	return true;
+}
+
+int triangle_mesh::hit_group(const triangle_group& group, const ray& r, double t_min, double& t_max) const {
+	// Below this the ray runs parallel to the triangle
+	constexpr double epsilon = 1e-12;
+
+	const double ox = r.origin.x(), oy = r.origin.y(), oz = r.origin.z();
+	const double dx = r.direction.x(), dy = r.direction.y(), dz = r.direction.z();
+
+	// Moller-Trumbore on every slot at once, the loop has no branches and vectorises
+	alignas(64) std::array<double, triangle_group_size> t_hit;
+	for (int i = 0; i < triangle_group_size; i++) {
+		const double e1x = group.edge1[0][i], e1y = group.edge1[1][i], e1z = group.edge1[2][i];
+		const double e2x = group.edge2[0][i], e2y = group.edge2[1][i], e2z = group.edge2[2][i];
+
+		// p = d x e2
+		const double px = dy * e2z - dz * e2y;
+		const double py = dz * e2x - dx * e2z;
+		const double pz = dx * e2y - dy * e2x;
+		const double det = e1x * px + e1y * py + e1z * pz;
+		const bool facing = fabs(det) > epsilon;
+		const double inv_det = 1.0 / (facing ? det : 1.0);
+
+		// s = o - corner, q = s x e1
+		const double sx = ox - group.corner[0][i];
+		const double sy = oy - group.corner[1][i];
+		const double sz = oz - group.corner[2][i];
+		const double u = (sx * px + sy * py + sz * pz) * inv_det;
+		const double qx = sy * e1z - sz * e1y;
+		const double qy = sz * e1x - sx * e1z;
+		const double qz = sx * e1y - sy * e1x;
+		const double v = (dx * qx + dy * qy + dz * qz) * inv_det;
+		const double t = (e2x * qx + e2y * qy + e2z * qz) * inv_det;
+
+		t_hit[i] = facing && u >= 0 && v >= 0 && u + v <= 1 && t >= t_min ? t : infinity;
+	}
+
+	int closest = -1;
+	for (int i = 0; i < triangle_group_size; i++) {
+		if (t_hit[i] < t_max) {
+			closest = i;
+			t_max = t_hit[i];
+		}
+	}
+
+	return closest;
+}
+
+bool triangle_mesh::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+	uint32_t hit_triangle = 0;
+	double closest_so_far = t_max;
+	const bool hit_anything = traverse_closest(nodes, r, t_min, closest_so_far, [&](const linear_bvh_node& node, double& t) {
+		if constexpr (enable_traversal_stats) {
+			thread_traversal_stats().primitive_tests++;
+		}
+		const triangle_group& group = groups[node.offset];
+		const int slot = hit_group(group, r, t_min, t);
+		if (slot < 0) {
+			return false;
+		}
+		hit_triangle = group.triangle[slot];
+		return true;
+	});
+
+	if (!hit_anything) {
+		return false;
+	}
+
+	// Only the closest triangle fills in the hit record
+	const point3 v0 = vertex(indices[3 * hit_triangle]);
+	const point3 v1 = vertex(indices[3 * hit_triangle + 1]);
+	const point3 v2 = vertex(indices[3 * hit_triangle + 2]);
+
+	rec.t = closest_so_far;
+	rec.p = r.at(rec.t);
+	rec.mat_ptr = mat_ptr;
+	rec.object = this;
+	rec.set_face_normal(r, unit_vector(cross(v1 - v0, v2 - v0)));
+
+	return true;
+}
+
+bool triangle_mesh::occluded(const ray& r, const double t_min, const double t_max) const {
+	return traverse_any(nodes, r, t_min, t_max, [&](const linear_bvh_node& node) {
+		double t_hit = t_max;
+		return hit_group(groups[node.offset], r, t_min, t_hit) >= 0;
+	});
+}
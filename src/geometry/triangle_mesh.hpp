@@ -0,0 +1,66 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "acceleration/bvh_builder.hpp"
+#include "scene/hittable.hpp"
+
+// Up to triangle_group_size triangles stored as structure of arrays, each as
+// one corner and the two edges leaving it, which is what the Moller-Trumbore
+// test works with. Unused slots repeat the last triangle.
+constexpr int triangle_group_size = 8;
+
+struct alignas(64) triangle_group {
+	std::array<double, triangle_group_size> corner[3];
+	std::array<double, triangle_group_size> edge1[3];
+	std::array<double, triangle_group_size> edge2[3];
+	// Index of the triangle each slot holds
+	std::array<uint32_t, triangle_group_size> triangle;
+};
+
+// An indexed triangle mesh behind a bvh of its own. Each leaf is one
+// triangle_group, so a ray tests a whole leaf in a single SIMD pass.
+// The mesh is shaded with the geometric normal of each triangle.
+class triangle_mesh : public hittable {
+public:
+	triangle_mesh() = default;
+
+	// Positions are stored one axis per array, indices hold three vertices per triangle.
+	// The leaf size and costs in the build options are set by the mesh itself.
+	triangle_mesh(std::array<std::vector<double>, 3> vertex_positions, std::vector<uint32_t> vertex_indices, std::shared_ptr<material> m,
+		const bvh_build_options& build_options = {});
+
+	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
+	virtual bool bounding_box(aabb& output_box) const override;
+	virtual bool occluded(const ray& r, const double t_min, const double t_max) const override;
+
+	size_t vertex_count() const { return positions[0].size(); }
+	size_t triangle_count() const { return indices.size() / 3; }
+
+	point3 vertex(const uint32_t index) const {
+		return point3(positions[0][index], positions[1][index], positions[2][index]);
+	}
+
+private:
+	void build(const bvh_build_options& options);
+	// Takes the tree and groups from the bvh cache, false when it has none for this key
+	bool load_cached(const std::string& directory, uint64_t key);
+
+	// Finds the closest triangle of a group within the interval and lowers
+	// t_max to it. Returns the slot, or -1 when no triangle is hit.
+	int hit_group(const triangle_group& group, const ray& r, double t_min, double& t_max) const;
+
+public:
+	std::array<std::vector<double>, 3> positions;
+	std::vector<uint32_t> indices;
+	std::shared_ptr<material> mat_ptr;
+
+	// Leaves point at their group instead of a primitive range
+	std::vector<linear_bvh_node> nodes;
+	std::vector<triangle_group> groups;
+	bvh_build_stats stats;
+};
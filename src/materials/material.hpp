@@ -6,11 +6,44 @@
 
 struct hit_record;
 
+// Lets the wavefront renderer group hits by material without RTTI
+enum class material_kind : uint8_t {
+	lambertian,
+	metal,
+	dielectric,
+	diffuse_light,
+	isotropic
+};
+
+constexpr int material_kind_count = 5;
+
 struct material {
+	const material_kind kind;
+
+	explicit material(const material_kind k) : kind(k) {}
+	virtual ~material() = default;
+
 	virtual color emitted() const {
 		return color(0, 0, 0);
 	}
 	virtual bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const = 0;
+
+	// Next event estimation asks materials about directions they didn't pick
+	// themselves. evaluate gives the fraction of the light arriving from
+	// direction that leaves back along r_in, cosine included, and scatter_pdf
+	// the density with which scatter picks direction. Both stay 0 for
+	// materials that only ever scatter into a single direction.
+	virtual color evaluate(const ray& r_in, const hit_record& rec, const vec3& direction) const {
+		return color(0, 0, 0);
+	}
+	virtual double scatter_pdf(const ray& r_in, const hit_record& rec, const vec3& direction) const {
+		return 0;
+	}
+
+	// Materials worth sampling lights for
+	bool diffuse() const {
+		return kind == material_kind::lambertian || kind == material_kind::isotropic;
+	}
 };
 
 // A lambertian is a material that absorbs light.
@@ -18,7 +51,7 @@ struct material {
 struct lambertian : public material {
 	color albedo;
 
-	lambertian(const color& a) : albedo(a) {}
+	lambertian(const color& a) : material(material_kind::lambertian), albedo(a) {}
 
 	virtual bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
 		auto scatter_direction = rec.normal + random_unit_vector();
@@ -31,6 +64,14 @@ struct lambertian : public material {
 
 		return true;
 	}
+
+	// scatter picks directions by cosine, which is exactly what evaluate weighs them by
+	virtual color evaluate(const ray& r_in, const hit_record& rec, const vec3& direction) const override {
+		return albedo * scatter_pdf(r_in, rec, direction);
+	}
+	virtual double scatter_pdf(const ray& r_in, const hit_record& rec, const vec3& direction) const override {
+		return std::max(0.0, dot(rec.normal, unit_vector(direction))) / std::numbers::pi;
+	}
 };
 
 // A metal is a material that reflects light.
@@ -40,7 +81,7 @@ struct metal : public material {
 	// needs to be between 0 and 1
 	double fuzz;
 
-	metal(const color& a, const double f) : albedo(a), fuzz(f < 1 ? f : 1) {}
+	metal(const color& a, const double f) : material(material_kind::metal), albedo(a), fuzz(f < 1 ? f : 1) {}
 
 	virtual bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
 		vec3 reflected = reflect(unit_vector(r_in.direction), rec.normal);
@@ -59,7 +100,7 @@ struct dielectric : public material {
 	// Index of refraction
 	double ir;
 
-	dielectric(const double index_of_refraction) : ir(index_of_refraction) {}
+	dielectric(const double index_of_refraction) : material(material_kind::dielectric), ir(index_of_refraction) {}
 
 	// Snell's Law
 	// This scatters the rays through the dielectric.
@@ -97,8 +138,8 @@ private:
 // These will render as light sources.
 class diffuse_light : public material {
 public:
-	diffuse_light(std::shared_ptr<color> a) : emit(a) {}
-	diffuse_light(const color& c) : emit(std::make_shared<color>(c)) {}
+	diffuse_light(std::shared_ptr<color> a) : material(material_kind::diffuse_light), emit(a) {}
+	diffuse_light(const color& c) : material(material_kind::diffuse_light), emit(std::make_shared<color>(c)) {}
 
 	virtual bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
 		return false;
@@ -115,7 +156,7 @@ public:
 
 class isotropic : public material {
 public:
-	isotropic(const color& c) : albedo(std::make_shared<color>(c)) {}
+	isotropic(const color& c) : material(material_kind::isotropic), albedo(std::make_shared<color>(c)) {}
 	
 	virtual bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override {
 		scattered = ray(rec.p, random_in_unit_sphere());
@@ -123,6 +164,14 @@ public:
 		return true;
 	}
 
+	// Scatters evenly into every direction
+	virtual color evaluate(const ray& r_in, const hit_record& rec, const vec3& direction) const override {
+		return *albedo / (4 * std::numbers::pi);
+	}
+	virtual double scatter_pdf(const ray& r_in, const hit_record& rec, const vec3& direction) const override {
+		return 1 / (4 * std::numbers::pi);
+	}
+
 public:
 	std::shared_ptr<color> albedo;
 };
\ No newline at end of file
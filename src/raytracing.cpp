@@ -1,12 +1,133 @@
+#include <string>
+
 #include "render/render.hpp"
+#include "render/benchmark.hpp"
+
+int main(int argc, char* argv[]) {
+	// Compare the acceleration structures instead of rendering
+	if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+		benchmark_acceleration(240, 240, 4);
+		return 0;
+	}
 
-int main() {
 	render renderer;
+	bool progressive = false;
+	bool wavefront = false;
+
+	for (int a = 1; a < argc; a++) {
+		const std::string option = argv[a];
+		const bool has_value = a + 1 < argc;
+
+		// Render a model file inside the cornell box instead of the default scene
+		if (option == "--mesh" && has_value) {
+			scene::mesh_path = argv[++a];
+			renderer.world.clear();
+			renderer.init_scene(scene::mesh_cornell_box);
+		}
+		// Trace bounce by bounce over large batches of paths instead of one path at a time
+		else if (option == "--wavefront") {
+			wavefront = true;
+		}
+		// Render in passes that each add samples to the whole frame
+		else if (option == "--progressive") {
+			progressive = true;
+		}
+		else if (option == "--write-passes") {
+			progressive = true;
+			renderer.write_passes = true;
+		}
+		else if (option == "--time-limit" && has_value) {
+			progressive = true;
+			renderer.time_limit_seconds = std::stod(argv[++a]);
+		}
+		else if (option == "--target" && has_value) {
+			progressive = true;
+			renderer.convergence_target = std::stod(argv[++a]);
+		}
+		// Spend samples where the image is noisy, down to an error threshold
+		else if (option == "--adaptive") {
+			progressive = true;
+			renderer.adaptive_sampling = true;
+		}
+		else if (option == "--adaptive-threshold" && has_value) {
+			progressive = true;
+			renderer.adaptive_sampling = true;
+			renderer.adaptive_threshold = std::stod(argv[++a]);
+		}
+		else if (option == "--max-depth" && has_value) {
+			renderer.max_depth = std::stoi(argv[++a]);
+		}
+		// Same seed, same image
+		else if (option == "--seed" && has_value) {
+			renderer.seed = std::stoull(argv[++a]);
+		}
+		// Worker threads, 0 picks the pool default
+		else if (option == "--threads" && has_value) {
+			renderer.threads = std::stoi(argv[++a]);
+		}
+		// Bounce from which Russian roulette may end paths early
+		else if (option == "--roulette-depth" && has_value) {
+			renderer.roulette_depth = std::stoi(argv[++a]);
+		}
+		// Only find lights by scattering, as before next event estimation
+		else if (option == "--no-light-sampling") {
+			renderer.next_event_estimation = false;
+		}
+		// Node layout the scene's bvh is traced with
+		else if (option == "--layout" && has_value) {
+			const std::string type = argv[++a];
+			if (type == "binary") {
+				renderer.set_layout(bvh_layout::binary);
+			}
+			else if (type == "bvh4") {
+				renderer.set_layout(bvh_layout::bvh4);
+			}
+			else if (type == "bvh8") {
+				renderer.set_layout(bvh_layout::bvh8);
+			}
+			else {
+				std::cerr << "Unknown layout " << type << ", expected binary, bvh4 or bvh8\n";
+				return 1;
+			}
+		}
+		// Where the random numbers of the samples come from
+		else if (option == "--sampler" && has_value) {
+			const std::string type = argv[++a];
+			if (type == "independent") {
+				renderer.sampling = sampler_type::independent;
+			}
+			else if (type == "sobol") {
+				renderer.sampling = sampler_type::sobol;
+			}
+			else if (type == "blue-noise") {
+				renderer.sampling = sampler_type::blue_noise;
+			}
+			else {
+				std::cerr << "Unknown sampler " << type << ", expected independent, sobol or blue-noise\n";
+				return 1;
+			}
+		}
+		else if (option == "--sample-map") {
+			renderer.write_sample_map = true;
+		}
+		else {
+			std::cerr << "Unknown option " << option << "\n";
+			return 1;
+		}
+	}
 
 	//renderer.generate_image();
-	renderer.generate_image_multithreaded();
+	if (progressive) {
+		renderer.generate_image_progressive();
+	}
+	else if (wavefront) {
+		renderer.generate_image_wavefront();
+	}
+	else {
+		renderer.generate_image_multithreaded();
+	}
 	renderer.render_to_bmp();
 	renderer.render_to_ppm();
 
 	return 0;
-}
\ No newline at end of file
+}
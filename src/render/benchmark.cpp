@@ -0,0 +1,159 @@
+#include "render/benchmark.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "acceleration/linear_bvh.hpp"
+#include "acceleration/traversal_stats.hpp"
+#include "acceleration/wide_bvh.hpp"
+#include "core/ray_packet.hpp"
+#include "scene/scene.hpp"
+
+using scene_function = std::function<std::tuple<hittable_list, camera, std::function<color(const vec3&)>>(double)>;
+
+// Returns rays per second and how many of the rays hit something
+static std::tuple<double, size_t> trace_rays(const hittable& world, const std::vector<ray>& rays) {
+	size_t hits = 0;
+	hit_record rec;
+
+	if constexpr (enable_traversal_stats) {
+		thread_traversal_stats().reset();
+		thread_traversal_stats().rays = rays.size();
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (const auto& r : rays) {
+		if (world.hit(r, 0.001, infinity, rec)) {
+			hits++;
+		}
+	}
+
+	auto time = std::chrono::high_resolution_clock::now() - start;
+	double seconds = std::chrono::duration<double>(time).count();
+
+	return std::make_tuple(rays.size() / seconds, hits);
+}
+
+// The same for shadow rays, which only ask whether anything is in the way
+static std::tuple<double, size_t> trace_occlusion(const hittable& world, const std::vector<ray>& rays) {
+	size_t hits = 0;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (const auto& r : rays) {
+		if (world.occluded(r, 0.001, infinity)) {
+			hits++;
+		}
+	}
+
+	auto time = std::chrono::high_resolution_clock::now() - start;
+	double seconds = std::chrono::duration<double>(time).count();
+
+	return std::make_tuple(rays.size() / seconds, hits);
+}
+
+// The same for rays traced packet_size at a time, neighbouring rays share a packet
+static std::tuple<double, size_t> trace_packets(const hittable& world, const std::vector<ray>& rays) {
+	size_t hits = 0;
+	packet_hit_record rec;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (size_t first = 0; first < rays.size(); first += packet_size) {
+		ray_packet packet;
+		for (size_t i = first; i < std::min(first + packet_size, rays.size()); i++) {
+			packet.add(rays[i]);
+		}
+
+		rec.t_max.fill(infinity);
+		hits += std::popcount(world.hit_packet(packet, 0.001, rec, packet.active()));
+	}
+
+	auto time = std::chrono::high_resolution_clock::now() - start;
+	double seconds = std::chrono::duration<double>(time).count();
+
+	return std::make_tuple(rays.size() / seconds, hits);
+}
+
+void benchmark_acceleration(const int image_width, const int image_height, const int samples_per_pixel) {
+	const std::vector<std::pair<const char*, scene_function>> scenes = {
+		{ "default_scene", scene::default_scene },
+		{ "random_scene", scene::random_scene },
+		{ "basic_light", scene::basic_light },
+		{ "simple_light", scene::simple_light },
+		{ "basic_cornell_box", scene::basic_cornell_box },
+		{ "smoke_cornell_box", scene::smoke_cornell_box },
+		{ "final_scene", scene::final_scene },
+		{ "mesh_cornell_box", scene::mesh_cornell_box }
+	};
+	const bvh_layout layouts[] = { bvh_layout::binary, bvh_layout::bvh4, bvh_layout::bvh8 };
+
+	const double aspect_ratio = static_cast<double>(image_width) / image_height;
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << std::left << std::setw(20) << "scene" << std::setw(10) << "layout"
+		<< std::right << std::setw(16) << "primary Mray/s" << std::setw(16) << "packet Mray/s" << std::setw(18) << "secondary Mray/s" << std::setw(18) << "occlusion Mray/s" << std::endl;
+
+	for (const auto& [name, scene_func] : scenes) {
+		auto [objects, cam, background] = scene_func(aspect_ratio);
+		auto binary = std::make_shared<linear_bvh>(objects);
+
+		// Camera rays, then one diffuse bounce from wherever they landed
+		std::vector<ray> primary;
+		std::vector<ray> secondary;
+		primary.reserve(static_cast<size_t>(image_width) * image_height * samples_per_pixel);
+
+		for (int j = 0; j < image_height; j++) {
+			for (int i = 0; i < image_width; i++) {
+				for (int s = 0; s < samples_per_pixel; s++) {
+					auto u = (i + random_double()) / (image_width - 1);
+					auto v = (j + random_double()) / (image_height - 1);
+					primary.push_back(cam.get_ray(u, v));
+				}
+			}
+		}
+
+		hit_record rec;
+		for (const auto& r : primary) {
+			if (binary->hit(r, 0.001, infinity, rec)) {
+				secondary.emplace_back(rec.p, rec.normal + random_unit_vector());
+			}
+		}
+
+		// Every layout of the object split tree, then the render's layout over a spatial split tree
+		bvh_build_options spatial_options;
+		spatial_options.spatial_splits = true;
+		auto spatial = std::make_shared<linear_bvh>(objects, spatial_options);
+
+		std::vector<std::tuple<std::string, std::shared_ptr<hittable>>> worlds;
+		for (auto layout : layouts) {
+			worlds.emplace_back(to_string(layout), with_layout(binary, layout));
+		}
+		worlds.emplace_back(std::string("s") + to_string(bvh_layout::bvh8), with_layout(spatial, bvh_layout::bvh8));
+
+		for (const auto& [label, world] : worlds) {
+			auto [primary_rate, primary_hits] = trace_rays(*world, primary);
+			auto [packet_rate, packet_hits] = trace_packets(*world, primary);
+			auto [occlusion_rate, occlusion_hits] = trace_occlusion(*world, secondary);
+			auto [secondary_rate, secondary_hits] = trace_rays(*world, secondary);
+
+			std::cout << std::left << std::setw(20) << name << std::setw(10) << label
+				<< std::right << std::setw(16) << primary_rate / 1e6 << std::setw(16) << packet_rate / 1e6
+				<< std::setw(18) << secondary_rate / 1e6 << std::setw(18) << occlusion_rate / 1e6 << std::endl;
+
+			if constexpr (enable_traversal_stats) {
+				// Counters from the secondary rays, the last pass traced one ray at a time
+				std::cout << "    secondary: " << thread_traversal_stats() << std::endl;
+			}
+		}
+	}
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// Traces the same set of rays through every bvh layout for each built in
+// scene and prints the rays per second each one reaches
+void benchmark_acceleration(const int image_width, const int image_height, const int samples_per_pixel);
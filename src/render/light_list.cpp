@@ -0,0 +1,284 @@
+#include "render/light_list.hpp"
+
+#include <algorithm>
+
+void light_list::light_bounds::add(const light_bounds& other) {
+	if (box.is_empty()) {
+		*this = other;
+		return;
+	}
+	box.expand(other.box);
+	power += other.power;
+
+	// Smallest cone holding both cones. Both are mirrored through their
+	// apex as well, so the other axis may be flipped onto this side.
+	const vec3 other_axis = dot(axis, other.axis) < 0 ? -other.axis : other.axis;
+	const double between = std::acos(clamp(dot(axis, other_axis), -1, 1));
+	if (std::min(between + other.normal_angle, std::numbers::pi) <= normal_angle) {
+		return;
+	}
+	if (std::min(between + normal_angle, std::numbers::pi) <= other.normal_angle) {
+		axis = other_axis;
+		set_normal_angle(other.normal_angle);
+		return;
+	}
+
+	const double angle = (normal_angle + between + other.normal_angle) / 2;
+	if (angle >= std::numbers::pi / 2) {
+		// Together with its mirror image such a cone covers every direction
+		set_normal_angle(std::numbers::pi);
+		return;
+	}
+
+	// Turn the axis towards the other one until the cone reaches around both
+	const double t = (angle - normal_angle) / between;
+	axis = unit_vector(std::sin((1 - t) * between) * axis + std::sin(t * between) * other_axis);
+	set_normal_angle(angle);
+}
+
+void light_list::light_bounds::set_normal_angle(const double angle) {
+	normal_angle = angle;
+	cos_normal_angle = std::cos(angle);
+	sin_normal_angle = std::sin(angle);
+}
+
+namespace {
+
+// Cosine and sine of max(0, a - b), from those of a and b
+double cos_difference(const double sin_a, const double cos_a, const double sin_b, const double cos_b) {
+	return cos_a > cos_b ? 1 : cos_a * cos_b + sin_a * sin_b;
+}
+
+double sin_difference(const double sin_a, const double cos_a, const double sin_b, const double cos_b) {
+	return cos_a > cos_b ? 0 : sin_a * cos_b - cos_a * sin_b;
+}
+
+}
+
+double light_list::light_bounds::importance(const point3& p, const vec3& normal) const {
+	const vec3 to_p = p - box.center();
+	const double distance_squared = to_p.length_squared();
+	const double radius_squared = (box.max() - box.min()).length_squared() / 4;
+
+	// Inside the bounds light may arrive head on and the distance says little
+	if (distance_squared <= radius_squared) {
+		return power / radius_squared;
+	}
+
+	// Light reaches p at an angle to the closest normal of at least the angle
+	// between the axis and the way to p, less the spread of the normals and
+	// the angle the bounds take up as seen from p. Worked out on cosines, as
+	// this runs twice for every level of the tree.
+	const double cos_to_axis = std::min(1.0, std::fabs(dot(axis, to_p)) / std::sqrt(distance_squared));
+	const double sin_to_axis = std::sqrt(std::max(0.0, 1 - cos_to_axis * cos_to_axis));
+	const double sin_bounds = std::sqrt(radius_squared / distance_squared);
+	const double cos_bounds = std::sqrt(1 - radius_squared / distance_squared);
+
+	const double cos_outside = cos_difference(sin_to_axis, cos_to_axis, sin_normal_angle, cos_normal_angle);
+	const double sin_outside = sin_difference(sin_to_axis, cos_to_axis, sin_normal_angle, cos_normal_angle);
+	const double cos_angle = cos_difference(sin_outside, cos_outside, sin_bounds, cos_bounds);
+	if (cos_angle <= 0) {
+		return 0;
+	}
+
+	// Likewise the light arrives at p at an angle to its normal of at least
+	// the angle to the center of the bounds less the angle they take up
+	double cos_incident = 1;
+	if (normal.length_squared() > 0) {
+		const double cos_to_center = clamp(-dot(normal, to_p) / std::sqrt(distance_squared), -1, 1);
+		const double sin_to_center = std::sqrt(std::max(0.0, 1 - cos_to_center * cos_to_center));
+		cos_incident = cos_difference(sin_to_center, cos_to_center, sin_bounds, cos_bounds);
+		if (cos_incident <= 0) {
+			return 0;
+		}
+	}
+
+	return power * cos_angle * cos_incident / distance_squared;
+}
+
+void light_list::build(const hittable_list& objects) {
+	lights.clear();
+	nodes.clear();
+	light_of.clear();
+
+	for (const auto& object : objects.objects) {
+		const material* mat = object->surface_material();
+		const double area = object->surface_area();
+		aabb box;
+		if (mat == nullptr || mat->kind != material_kind::diffuse_light || area <= 0 || !object->bounding_box(box)) {
+			continue;
+		}
+
+		light_of.emplace(object.get(), lights.size());
+		light& l = lights.emplace_back();
+		l.object = object;
+		l.mat = mat;
+		l.bounds.box = box;
+		l.bounds.power = luminance(mat->emitted()) * area;
+		l.bounds.set_normal_angle(object->surface_normal_bounds(l.bounds.axis));
+	}
+
+	if (!lights.empty()) {
+		std::vector<uint32_t> order(lights.size());
+		for (size_t i = 0; i < order.size(); i++) {
+			order[i] = static_cast<uint32_t>(i);
+		}
+		build_tree(order.begin(), order.end(), 0, 0);
+	}
+}
+
+uint32_t light_list::build_tree(std::vector<uint32_t>::iterator begin, std::vector<uint32_t>::iterator end, const uint64_t trail, const int depth) {
+	const auto index = static_cast<uint32_t>(nodes.size());
+	nodes.push_back({});
+
+	light_bounds bounds;
+	aabb centers = aabb::empty();
+	for (auto l = begin; l != end; l++) {
+		bounds.add(lights[*l].bounds);
+		centers.expand(lights[*l].bounds.box.center());
+	}
+
+	if (end - begin == 1) {
+		lights[*begin].trail = trail;
+		nodes[index] = { bounds, *begin, true };
+		return index;
+	}
+
+	// Halves at the median along the widest spread of centers, which keeps the
+	// tree balanced and well within the 64 turns a trail can hold
+	const int axis = centers.longest_axis();
+	const auto middle = begin + (end - begin) / 2;
+	std::nth_element(begin, middle, end, [&](const uint32_t a, const uint32_t b) {
+		return lights[a].bounds.box.center()[axis] < lights[b].bounds.box.center()[axis];
+	});
+
+	build_tree(begin, middle, trail, depth + 1);
+	const uint32_t second = build_tree(middle, end, trail | (uint64_t(1) << depth), depth + 1);
+	nodes[index] = { bounds, second, false };
+	return index;
+}
+
+bool light_list::pick_light(const point3& p, const vec3& normal, size_t& index, double& pmf) const {
+	uint32_t current = 0;
+	pmf = 1;
+
+	// One random number for the whole walk, rescaled after every choice
+	double u = random_double();
+	while (!nodes[current].leaf) {
+		const double first = nodes[current + 1].bounds.importance(p, normal);
+		const double second = nodes[nodes[current].offset].bounds.importance(p, normal);
+		if (first + second <= 0) {
+			return false;
+		}
+
+		const double p_first = first / (first + second);
+		if (u < p_first) {
+			u = u / p_first;
+			pmf *= p_first;
+			current = current + 1;
+		}
+		else {
+			u = std::min((u - p_first) / (1 - p_first), 1 - 0x1p-53);
+			pmf *= 1 - p_first;
+			current = nodes[current].offset;
+		}
+	}
+
+	index = nodes[current].offset;
+	return true;
+}
+
+double light_list::light_pmf(const point3& p, const vec3& normal, const size_t index) const {
+	uint32_t current = 0;
+	double pmf = 1;
+	for (int depth = 0; !nodes[current].leaf; depth++) {
+		const double first = nodes[current + 1].bounds.importance(p, normal);
+		const double second = nodes[nodes[current].offset].bounds.importance(p, normal);
+		if (first + second <= 0) {
+			return 0;
+		}
+
+		if (lights[index].trail >> depth & 1) {
+			pmf *= 1 - first / (first + second);
+			current = nodes[current].offset;
+		}
+		else {
+			pmf *= first / (first + second);
+			current = current + 1;
+		}
+	}
+	return pmf;
+}
+
+vec3 light_list::receiver_normal(const hit_record& rec) {
+	// Media scatter the same into every direction and have no normal
+	return rec.mat_ptr->kind == material_kind::lambertian ? rec.normal : vec3(0, 0, 0);
+}
+
+color light_list::direct(const hittable& world, const ray& r, const hit_record& rec) const {
+	if (lights.empty() || !rec.mat_ptr->diffuse()) {
+		return color(0, 0, 0);
+	}
+
+	// A light from the tree, then a point on that light
+	size_t index;
+	double pmf;
+	if (!pick_light(rec.p, receiver_normal(rec), index, pmf)) {
+		return color(0, 0, 0);
+	}
+	const light& l = lights[index];
+
+	point3 p;
+	vec3 normal;
+	l.object->sample_surface(rec.p, p, normal);
+
+	const vec3 to_light = p - rec.p;
+	const double distance_squared = to_light.length_squared();
+	const double distance = std::sqrt(distance_squared);
+	const vec3 direction = to_light / distance;
+	// Lights shine from both sides, like diffuse_light does when a ray hits it
+	const double cos_light = std::fabs(dot(normal, direction));
+	if (cos_light < 1e-6) {
+		return color(0, 0, 0);
+	}
+
+	const double scatter_pdf = rec.mat_ptr->scatter_pdf(r, rec, direction);
+	if (scatter_pdf <= 0) {
+		return color(0, 0, 0);
+	}
+
+	if (world.occluded(ray(rec.p, direction), 0.001, distance - 0.001)) {
+		return color(0, 0, 0);
+	}
+
+	const double pdf = pmf * l.object->surface_pdf(rec.p, p, normal);
+	const double weight = pdf * pdf / (pdf * pdf + scatter_pdf * scatter_pdf);
+	return l.mat->emitted() * rec.mat_ptr->evaluate(r, rec, direction) * (weight / pdf);
+}
+
+double light_list::emission_weight(const ray& r, const hit_record& rec, const double scatter_pdf, const vec3& scatter_normal) const {
+	if (scatter_pdf <= 0 || rec.mat_ptr->kind != material_kind::diffuse_light) {
+		return 1;
+	}
+
+	// Emitters the lights don't know about were never sampled, even when
+	// they share a material with one that was
+	const auto found = light_of.find(rec.object);
+	if (found == light_of.end()) {
+		return 1;
+	}
+
+	const double length = r.direction.length();
+	const double cos_light = std::fabs(dot(rec.normal, r.direction)) / length;
+	if (cos_light < 1e-6) {
+		return 1;
+	}
+
+	// r left from the point the light would have been sampled for
+	const double pmf = light_pmf(r.origin, scatter_normal, found->second);
+	if (pmf <= 0) {
+		return 1;
+	}
+	const double pdf = pmf * lights[found->second].object->surface_pdf(r.origin, rec.p, rec.normal);
+	return scatter_pdf * scatter_pdf / (scatter_pdf * scatter_pdf + pdf * pdf);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "acceleration/aabb.hpp"
+#include "core/color.hpp"
+#include "scene/hittable_list.hpp"
+#include "materials/material.hpp"
+
+// Next event estimation. At every diffuse hit a point on a light is picked and
+// a shadow ray sent to it, and that light is combined with the light the
+// scattered ray happens to find through multiple importance sampling with the
+// power heuristic.
+//
+// Which light gets picked is decided by walking a tree with one leaf per
+// emitting object. The tree bounds where each subtree sits, how much power it
+// emits and which way, and at every node goes towards the side that likely
+// lights the point more.
+class light_list {
+public:
+	// Collects the emitting top level objects that can be sampled
+	void build(const hittable_list& objects);
+
+	bool empty() const { return lights.empty(); }
+	size_t size() const { return lights.size(); }
+
+	// Light from a sampled point on a light that rec reflects back along r,
+	// already weighted against finding the same light by scattering
+	color direct(const hittable& world, const ray& r, const hit_record& rec) const;
+
+	// Weight of the light emitted at rec when r found it by scattering with
+	// density scatter_pdf. 0 marks a bounce off a mirror or a camera ray,
+	// which the lights could never have been sampled for. scatter_normal is
+	// receiver_normal of the hit r scattered off.
+	double emission_weight(const ray& r, const hit_record& rec, const double scatter_pdf, const vec3& scatter_normal) const;
+
+	// Normal the lights are picked for at rec, 0 when light may arrive from anywhere
+	static vec3 receiver_normal(const hit_record& rec);
+
+private:
+	// What a subtree of lights looks like from afar. diffuse_light shines
+	// from both sides of a surface, so light leaves within normal_angle of
+	// either axis or -axis.
+	struct light_bounds {
+		aabb box = aabb::empty();
+		double power = 0;
+		vec3 axis = vec3(0, 0, 1);
+		double normal_angle = 0;
+		double cos_normal_angle = 1;
+		double sin_normal_angle = 0;
+
+		void set_normal_angle(const double angle);
+		void add(const light_bounds& other);
+		// Estimate of how much light the subtree sends towards p, 0 only
+		// when it can't light p at all. Light arriving from behind normal
+		// doesn't count, unless normal is 0.
+		double importance(const point3& p, const vec3& normal) const;
+	};
+
+	struct light {
+		std::shared_ptr<hittable> object;
+		const material* mat = nullptr;
+		light_bounds bounds;
+		// Turns taken from the root to this light's leaf, a set bit for the second child
+		uint64_t trail = 0;
+	};
+
+	// Like linear_bvh, the first child directly follows its parent and
+	// offset leads to the second child, or to the light for a leaf
+	struct light_node {
+		light_bounds bounds;
+		uint32_t offset;
+		bool leaf;
+	};
+
+	uint32_t build_tree(std::vector<uint32_t>::iterator begin, std::vector<uint32_t>::iterator end, const uint64_t trail, const int depth);
+	// Picks a light with probability pmf, false when no light reaches p
+	bool pick_light(const point3& p, const vec3& normal, size_t& index, double& pmf) const;
+	// Probability of pick_light choosing the light at index for p
+	double light_pmf(const point3& p, const vec3& normal, const size_t index) const;
+
+	std::vector<light> lights;
+	std::vector<light_node> nodes;
+	// Index of every object that can be sampled in lights
+	std::unordered_map<const hittable*, size_t> light_of;
+};
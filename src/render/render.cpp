@@ -3,6 +3,7 @@
 void render::generate_image() {
 	// Render
 	auto start = std::chrono::high_resolution_clock::now();
+	prepare_sampling(samples_per_pixel);
 
 	for(int j = image_height - 1; j >= 0; --j) {
 		std::cerr << "\rScanlines remaining: " << j << ' ' << std::flush;
@@ -21,37 +22,32 @@ void render::generate_image() {
 void render::generate_image_multithreaded() {
 	// Render
 	auto start = std::chrono::high_resolution_clock::now();
+	prepare_sampling(samples_per_pixel);
 
-	pool p;
-	std::vector<std::future<color>> results;
+	// Rows of the framebuffer run top to bottom, the same order image is in
+	std::vector<color> framebuffer(static_cast<size_t>(image_width) * image_height);
+	tile_scheduler scheduler(image_width, image_height, 16, threads);
 
-	for(int j = image_height - 1; j >= 0; --j) {
-		for(int i = 0; i < image_width; ++i) {
-			results.push_back(p.enqueue_task(&render::pixel_color, this, i, j));
-		}
-	}
-
-	p.start_pool();
-
-	std::cout << "Threads started" << std::endl;
-	std::cout << "Total pixels: " << p.remaining_tasks.load() << std::endl;
+	std::cout << "Rendering " << scheduler.tile_count() << " tiles on " << scheduler.thread_count() << " threads" << std::endl;
 
-	const int total_tasks = image_height * image_width;
-	
-	while(p.remaining_tasks.load()) {
-		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	auto render_tile = [&](const tile& t) {
+		for (int row = t.y0; row < t.y1; row++) {
+			for (int i = t.x0; i < t.x1; i++) {
+				framebuffer[static_cast<size_t>(row) * image_width + i] = pixel_color(i, image_height - 1 - row);
+			}
+		}
+	};
 
+	auto progress = [&](size_t done, size_t total) {
 		auto elapsed_time = std::chrono::high_resolution_clock::now() - start;
 		auto elapsed_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed_time).count();
 
-		print_progress_bar(static_cast<double>(total_tasks) - p.remaining_tasks.load(), total_tasks, elapsed_time_ms);
-	}
+		print_progress_bar(static_cast<double>(done), static_cast<double>(total), elapsed_time_ms);
+	};
 
-	p.join_threads();
+	scheduler.run(render_tile, progress);
 
-	for(auto& pixel : results) {
-		image.push_back(get_normalized_color(pixel.get(), samples_per_pixel));
-	}
+	resolve_image(framebuffer, std::vector<int>(framebuffer.size(), samples_per_pixel));
 
 	std::cerr << "\nDone.\n";
 
@@ -60,6 +56,183 @@ void render::generate_image_multithreaded() {
 	std::cerr << "Image generated in " << ms_to_time(time_ms) << std::endl;
 }
 
+void render::generate_image_progressive() {
+	auto start = std::chrono::high_resolution_clock::now();
+	auto elapsed_seconds = [&start]() {
+		return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	};
+
+	// Running sums over all passes. The luminance of the samples and its
+	// square tell how far each pixel still is from converging.
+	const size_t pixel_count = static_cast<size_t>(image_width) * image_height;
+	std::vector<color> accumulated(pixel_count);
+	std::vector<double> luminance_sum(pixel_count);
+	std::vector<double> luminance_squared(pixel_count);
+	std::vector<int> samples(pixel_count, 0);
+	// Pixels that still take samples, adaptive sampling retires the converged ones
+	std::vector<uint8_t> active(pixel_count, 1);
+	size_t active_count = pixel_count;
+
+	tile_scheduler scheduler(image_width, image_height, 16, threads);
+	const int pass_size = std::max(1, samples_per_pass);
+	const int max_samples = adaptive_sampling ? std::max(samples_per_pixel, adaptive_max_samples) : samples_per_pixel;
+	prepare_sampling(max_samples);
+	int samples_taken = 0;
+	int passes = 0;
+
+	std::cout << "Rendering progressively, " << pass_size << " samples per pass on " << scheduler.thread_count() << " threads" << std::endl;
+
+	while (samples_taken < max_samples && active_count > 0) {
+		const int first_sample = samples_taken;
+		const int sample_count = std::min(pass_size, max_samples - samples_taken);
+
+		scheduler.run([&](const tile& t) {
+			for (int row = t.y0; row < t.y1; row++) {
+				for (int i = t.x0; i < t.x1; i++) {
+					const size_t index = static_cast<size_t>(row) * image_width + i;
+					if (!active[index]) {
+						continue;
+					}
+
+					double squares = 0;
+					const color c = sample_pixel(i, image_height - 1 - row, first_sample, sample_count, squares);
+					accumulated[index] += c;
+					luminance_sum[index] += luminance(c);
+					luminance_squared[index] += squares;
+					samples[index] += sample_count;
+				}
+			}
+		});
+
+		samples_taken += sample_count;
+		passes++;
+
+		if (adaptive_sampling && samples_taken >= adaptive_min_samples) {
+			active_count = retire_converged(luminance_sum, luminance_squared, samples, active);
+		}
+
+		const double error = passes > 1 ? estimate_error(luminance_sum, luminance_squared, samples) : infinity;
+		std::cout << "Pass " << passes << ": " << samples_taken << " spp after " << ms_to_time(static_cast<uint64_t>(elapsed_seconds() * 1000));
+		if (passes > 1) {
+			std::cout << ", error " << error;
+		}
+		if (adaptive_sampling) {
+			std::cout << ", " << active_count << " pixels active";
+		}
+		std::cout << std::endl;
+
+		if (write_passes) {
+			resolve_image(accumulated, samples);
+			render_to_bmp();
+			render_to_ppm();
+		}
+
+		if (time_limit_seconds > 0 && elapsed_seconds() >= time_limit_seconds) {
+			std::cout << "Stopping, time limit reached" << std::endl;
+			break;
+		}
+		// A few passes rarely catch the bright paths that make the most noise,
+		// so the estimate runs low at first and isn't trusted straight away
+		if (convergence_target > 0 && passes >= 8 && error <= convergence_target) {
+			std::cout << "Stopping, converged" << std::endl;
+			break;
+		}
+	}
+
+	resolve_image(accumulated, samples);
+
+	size_t total_samples = 0;
+	for (const int count : samples) {
+		total_samples += count;
+	}
+	if (write_sample_map) {
+		render_sample_map(samples);
+	}
+
+	auto time_ms = static_cast<uint64_t>(elapsed_seconds() * 1000);
+	std::cerr << "Image generated in " << ms_to_time(time_ms) << " with " << static_cast<double>(total_samples) / pixel_count << " samples per pixel on average" << std::endl;
+}
+
+double render::pixel_error(const double sum, const double squares, const int samples) {
+	if (samples < 2) {
+		return infinity;
+	}
+
+	// The spread of the samples gives the standard error of their mean. The
+	// image is stored with gamma 2, where an error e around a brightness m
+	// shows up as e / (2 sqrt(m)), so that is what gets measured. The small
+	// offset keeps black pixels from dominating.
+	const double mean = sum / samples;
+	const double variance = std::max(0.0, squares / samples - mean * mean) / (samples - 1);
+	return std::sqrt(variance) / (2 * std::sqrt(mean) + 0.01);
+}
+
+double render::estimate_error(const std::vector<double>& sums, const std::vector<double>& squares, const std::vector<int>& samples) const {
+	double total = 0;
+	for (size_t i = 0; i < sums.size(); i++) {
+		total += pixel_error(sums[i], squares[i], samples[i]);
+	}
+	return total / static_cast<double>(sums.size());
+}
+
+size_t render::retire_converged(const std::vector<double>& sums, const std::vector<double>& squares, const std::vector<int>& samples,
+	std::vector<uint8_t>& active) const {
+	std::vector<uint8_t> noisy(active.size());
+	for (size_t i = 0; i < active.size(); i++) {
+		noisy[i] = active[i] && pixel_error(sums[i], squares[i], samples[i]) > adaptive_threshold;
+	}
+
+	// A pixel only stops once its whole neighbourhood has converged. One that
+	// merely got lucky and missed a rare bright path so far keeps going as
+	// long as its neighbours, which did catch some, are still noisy.
+	size_t active_count = 0;
+	for (int row = 0; row < image_height; row++) {
+		for (int i = 0; i < image_width; i++) {
+			const size_t index = static_cast<size_t>(row) * image_width + i;
+			if (!active[index]) {
+				continue;
+			}
+
+			bool keep = false;
+			for (int y = std::max(0, row - 1); y <= std::min(image_height - 1, row + 1) && !keep; y++) {
+				for (int x = std::max(0, i - 1); x <= std::min(image_width - 1, i + 1) && !keep; x++) {
+					keep = noisy[static_cast<size_t>(y) * image_width + x];
+				}
+			}
+
+			active[index] = keep;
+			active_count += keep;
+		}
+	}
+	return active_count;
+}
+
+void render::resolve_image(const std::vector<color>& accumulated, const std::vector<int>& samples) {
+	image.clear();
+	image.reserve(accumulated.size());
+	for (size_t i = 0; i < accumulated.size(); i++) {
+		image.push_back(get_normalized_color(accumulated[i], std::max(1, samples[i])));
+	}
+}
+
+void render::render_sample_map(const std::vector<int>& samples) {
+	// Brighter pixels took more samples, white is the most any pixel took
+	const int most = std::max(1, *std::max_element(samples.begin(), samples.end()));
+	std::vector<std::tuple<uint8_t, uint8_t, uint8_t>> map;
+	map.reserve(samples.size());
+	for (const int count : samples) {
+		const auto level = static_cast<uint8_t>(255 * count / most);
+		map.emplace_back(level, level, level);
+	}
+
+	std::ofstream out("samples.bmp", std::ios::binary);
+	bmp file(image_width, image_height);
+
+	file.write_to_file(out, map);
+
+	out.close();
+}
+
 void render::render_to_ppm() {
 	// Render
 	std::ofstream out("render.ppm");
@@ -88,36 +261,143 @@ void render::render_to_bmp() {
 	out.close();
 }
 
-color render::ray_color(const ray& r, const std::function<color(const vec3&)>& background, const hittable& world, const int depth) {
+color render::trace_path(const ray& r) {
 	hit_record rec;
 
-	// If we've exceeded the ray bounce limit, no more light is gathered
-	if(depth <= 0) return color(0, 0, 0);
+	// No bounces at all gathers no light
+	if (max_depth <= 0) return color(0, 0, 0);
 
 	// If the ray doesn't hit anything, return the background color
 	if (!world.hit(r, 0.001, infinity, rec)) {
 		return background(r.direction);
 	}
 
-	ray scattered;
-	color attenuation;
-	color emitted = rec.mat_ptr->emitted();
+	return trace_path(r, rec);
+}
+
+color render::trace_path(ray r, hit_record rec) {
+	color radiance(0, 0, 0);
+	// Fraction of the light arriving along r that makes it back to the camera
+	color throughput(1, 1, 1);
+	// Density of the direction r was scattered in, 0 while it is the camera ray
+	double scatter_pdf = 0;
+	vec3 scatter_normal;
+	const bool sample_lights = next_event_estimation && !lights.empty();
+
+	for (int depth = 1; ; depth++) {
+		thread_sampler().skip_to_dimension(camera_dimensions + (depth - 1) * bounce_dimensions);
+
+		const double weight = sample_lights ? lights.emission_weight(r, rec, scatter_pdf, scatter_normal) : 1;
+		radiance += throughput * rec.mat_ptr->emitted() * weight;
+
+		// Lights sampled here count as one more bounce
+		if (sample_lights && depth < max_depth) {
+			radiance += throughput * lights.direct(world, r, rec);
+		}
+
+		ray scattered;
+		color attenuation;
+		if (!rec.mat_ptr->scatter(r, rec, attenuation, scattered) || depth >= max_depth) {
+			break;
+		}
+		if (sample_lights) {
+			scatter_pdf = rec.mat_ptr->scatter_pdf(r, rec, scattered.direction);
+			scatter_normal = light_list::receiver_normal(rec);
+		}
+
+		throughput = throughput * attenuation;
+		if (depth >= roulette_depth && !survives_roulette(throughput)) {
+			break;
+		}
 
-	if(!rec.mat_ptr->scatter(r, rec, attenuation, scattered)) {
-		return emitted;
+		r = scattered;
+		if (!world.hit(r, 0.001, infinity, rec)) {
+			radiance += throughput * background(r.direction);
+			break;
+		}
 	}
 
-	return emitted + attenuation * ray_color(scattered, background, world, depth - 1);
+	return radiance;
 }
 
 color render::pixel_color(const int i, const int j) {
+	double luminance_squares = 0;
+	return sample_pixel(i, j, 0, samples_per_pixel, luminance_squares);
+}
+
+void render::prepare_sampling(const int max_samples) {
+	// Anything drawn outside a pixel's own sampler follows the seed as it is now
+	thread_sampler() = sampler(pcg32(mix_seed(seed), 0));
+
+	sampling_settings = sampler_settings();
+	sampling_settings.type = sampling;
+	sampling_settings.seed = seed;
+	sampling_settings.fit(image_width, image_height, max_samples);
+}
+
+sampler render::pixel_sampler(const int i, const int j, const int sample) const {
+	// Every sample of every pixel gets numbers of its own, so an image only
+	// depends on the seed and never on which thread took a sample or when
+	const uint64_t pixel = static_cast<uint64_t>(j) * image_width + i;
+	const pcg32 stream(mix_seed(mix_seed(seed ^ pixel) + static_cast<uint64_t>(sample)), pixel);
+	return sampler(sampling_settings, i, j, static_cast<uint32_t>(sample), stream);
+}
+
+color render::sample_pixel(const int i, const int j, const int first_sample, const int sample_count, double& luminance_squares) {
+	// Without depth of field the samples of a pixel leave the same point in
+	// nearly the same direction, so they share one trip through the bvh
+	if (packet_tracing && cam.is_pinhole() && max_depth > 0) {
+		return pixel_color_packets(i, j, first_sample, sample_count, luminance_squares);
+	}
+
 	color pixel_color(0, 0, 0);
-	for(int x = 0; x < samples_per_pixel; x++) {
-		auto u = double(i + random_double()) / (double(image_width) - 1);
-		auto v = double(j + random_double()) / (double(image_height) - 1);
+	for(int x = 0; x < sample_count; x++) {
+		thread_sampler() = pixel_sampler(i, j, first_sample + x);
+		const auto [du, dv] = random_double_2d();
+		auto u = double(i + du) / (double(image_width) - 1);
+		auto v = double(j + dv) / (double(image_height) - 1);
 
 		ray r = cam.get_ray(u, v);
-		pixel_color += ray_color(r, background, world, max_depth);
+		const color c = trace_path(r);
+		pixel_color += c;
+		luminance_squares += luminance(c) * luminance(c);
+	}
+
+	return pixel_color;
+}
+
+color render::pixel_color_packets(const int i, const int j, const int first_sample, const int sample_count, double& luminance_squares) {
+	color pixel_color(0, 0, 0);
+	for(int first = 0; first < sample_count; first += packet_size) {
+		// Each sample picks up its sampler where its camera ray left it once it is shaded
+		std::array<sampler, packet_size> samplers;
+		ray_packet packet;
+		for(int x = first; x < std::min(first + packet_size, sample_count); x++) {
+			thread_sampler() = pixel_sampler(i, j, first_sample + x);
+			const auto [du, dv] = random_double_2d();
+			auto u = double(i + du) / (double(image_width) - 1);
+			auto v = double(j + dv) / (double(image_height) - 1);
+			packet.add(cam.get_ray(u, v));
+			samplers[x - first] = thread_sampler();
+		}
+
+		// Media draw random numbers while the packet is traced. They come from
+		// a stream of the packet's own rather than from any one sample.
+		const uint64_t pixel = static_cast<uint64_t>(j) * image_width + i;
+		thread_sampler() = sampler(pcg32(mix_seed(mix_seed(seed ^ pixel) ^ (static_cast<uint64_t>(first_sample + first) << 32)), ~pixel));
+		packet_hit_record hits;
+		hits.t_max.fill(infinity);
+		const packet_mask hit_mask = world.hit_packet(packet, 0.001, hits, packet.active());
+
+		// Only the camera rays are coherent, everything after the first hit is traced alone
+		for(int x = 0; x < packet.count; x++) {
+			thread_sampler() = samplers[x];
+			const color c = (hit_mask >> x & 1)
+				? trace_path(packet.rays[x], hits.rec[x])
+				: background(packet.rays[x].direction);
+			pixel_color += c;
+			luminance_squares += luminance(c) * luminance(c);
+		}
 	}
 
 	return pixel_color;
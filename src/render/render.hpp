@@ -8,6 +8,7 @@
 #include "acceleration/bvh.hpp"
 #include "core/vec3.hpp"
 #include "core/ray.hpp"
+#include "core/ray_packet.hpp"
 #include "core/color.hpp"
 #include "camera/camera.hpp"
 #include "scene/hittable_list.hpp"
@@ -15,9 +16,25 @@
 #include "materials/material.hpp"
 #include "utils/util.hpp"
 #include "render/bmp.hpp"
-#include "utils/pool.hpp"
+#include "render/light_list.hpp"
+#include "utils/tile_scheduler.hpp"
 #include "scene/scene.hpp"
 #include "acceleration/improved_bvh.hpp"
+#include "acceleration/linear_bvh.hpp"
+#include "acceleration/wide_bvh.hpp"
+
+// Russian roulette. Ends a path with a probability that grows as its
+// throughput falls and scales the throughput of the paths that go on to make
+// up for the ones that ended, so the image stays unbiased. Returns whether the
+// path goes on.
+inline bool survives_roulette(color& throughput) {
+	const double p = std::min(1.0, std::max({ throughput.x(), throughput.y(), throughput.z() }));
+	if (random_double() >= p) {
+		return false;
+	}
+	throughput /= p;
+	return true;
+}
 
 struct render {
 	// Final Product
@@ -29,10 +46,50 @@ struct render {
 	int image_width = 1920 / 8;
 	int image_height = static_cast<int>(image_width / aspect_ratio);
 	int samples_per_pixel = 300;
-	int max_depth = 4;
+	int max_depth = 16;
+	// From this bounce on, Russian roulette ends paths that carry little light.
+	// Set it to max_depth or more to always trace paths to the full depth.
+	int roulette_depth = 4;
+	// Sample lights directly at diffuse hits and weigh them against the lights paths find by scattering
+	bool next_event_estimation = true;
+	// Trace the samples of a pixel together as packets when the camera has no depth of field
+	bool packet_tracing = true;
+	// Every random number of a render, the scene included, derives from this.
+	// The same seed always gives the same image, whatever the thread count.
+	// Scenes are laid out with the seed init_scene runs with, samples with the
+	// seed the render starts with.
+	uint64_t seed = 0;
+	// Worker threads, 0 picks the pool default
+	int threads = 0;
+	// Where the random numbers of the samples come from
+	sampler_type sampling = sampler_type::sobol;
+
+	// Progressive rendering takes this many samples per pixel in each pass over the frame
+	int samples_per_pass = 16;
+	// Writes the image so far after every pass
+	bool write_passes = false;
+	// Stops early once this much time has passed, 0 for no limit
+	double time_limit_seconds = 0;
+	// Stops early once the estimated noise of the image falls below this, 0 for never.
+	// It is measured on the 0 to 1 scale of the gamma corrected output.
+	double convergence_target = 0;
+
+	// Adaptive sampling stops taking samples for pixels whose estimated error
+	// fell below adaptive_threshold, measured like convergence_target, and
+	// keeps going on the noisy ones up to adaptive_max_samples. Only applies
+	// to progressive rendering.
+	bool adaptive_sampling = false;
+	double adaptive_threshold = 0.01;
+	int adaptive_min_samples = 64;
+	int adaptive_max_samples = 1024;
+	// Writes samples.bmp, showing how many samples each pixel took
+	bool write_sample_map = false;
 
 	// World
 	hittable_list world;
+	light_list lights;
+	bvh_build_options bvh_options;
+	bvh_layout layout = bvh_layout::bvh8;
 
 	// Camera
 	camera cam;
@@ -64,6 +121,9 @@ struct render {
 			case 6:
 				init_scene(scene::final_scene);
 				break;
+			case 7:
+				init_scene(scene::mesh_cornell_box);
+				break;
 			default:
 				// Throw a runtime error
 				throw std::runtime_error("Invalid scene selected");
@@ -77,10 +137,17 @@ struct render {
 	void init_scene(std::function<std::tuple<hittable_list, camera, std::function<color(const vec3&)>>(double)> scene_func) {
 		auto start = std::chrono::high_resolution_clock::now();
 
+		// Scenes that place objects at random are laid out the same on every run
+		thread_sampler() = sampler(pcg32(mix_seed(seed), 0));
 		auto [w, c, b] = scene_func(aspect_ratio);
 		
-		improved_bvh_node improved_bvh_world(w);
-		world.add(std::make_shared<improved_bvh_node>(improved_bvh_world));
+		bvh_build_options options = bvh_options;
+		options.cache_directory = scene::bvh_cache_directory;
+		scene_bvh = std::make_shared<linear_bvh>(w, options);
+		std::cout << scene_bvh->stats << std::endl;
+		world.add(with_layout(scene_bvh, layout));
+		lights.build(w);
+		std::cout << "Found " << lights.size() << " lights to sample" << std::endl;
 		cam = std::move(c);
 		background = std::move(b);
 
@@ -89,12 +156,58 @@ struct render {
 		std::cout << "Scene initialization took " << duration.count() << " microseconds" << std::endl;
 	}
 
+	// Traces the scene with another layout from now on, collapsed from the
+	// tree that was already built
+	void set_layout(const bvh_layout new_layout) {
+		layout = new_layout;
+		world.clear();
+		world.add(with_layout(scene_bvh, layout));
+	}
+
 	void generate_image();
 	void generate_image_multithreaded();
+	// Renders in passes over the whole frame until samples_per_pixel is
+	// reached or the time limit or convergence target stops it early
+	void generate_image_progressive();
+	// Same image as generate_image_multithreaded, traced a bounce at a time
+	// over batches of paths with the hits of each bounce grouped by material
+	void generate_image_wavefront();
 	void render_to_ppm();
 	void render_to_bmp();
 
 private:
-	color ray_color(const ray& r, const std::function<color(const vec3&)>& background, const hittable& world, const int depth);
+	// Light arriving along r, followed bounce by bounce with a running throughput
+	color trace_path(const ray& r);
+	// Same for a ray whose first hit is already known
+	color trace_path(ray r, hit_record rec);
 	color pixel_color(const int i, const int j);
+	void render_tile_wavefront(const tile& t, std::vector<color>& framebuffer);
+	// Sets up the samplers for an image with up to max_samples samples per pixel
+	void prepare_sampling(const int max_samples);
+	// Random numbers for one sample of one pixel
+	sampler pixel_sampler(const int i, const int j, const int sample) const;
+	// Sum of the samples numbered first_sample to first_sample + sample_count.
+	// The squared luminance of every sample is added to luminance_squares.
+	color sample_pixel(const int i, const int j, const int first_sample, const int sample_count, double& luminance_squares);
+	color pixel_color_packets(const int i, const int j, const int first_sample, const int sample_count, double& luminance_squares);
+	// Standard error of an output pixel, from the luminance of its samples
+	static double pixel_error(const double sum, const double squares, const int samples);
+	// Average error over all pixels
+	double estimate_error(const std::vector<double>& sums, const std::vector<double>& squares, const std::vector<int>& samples) const;
+	// Deactivates converged pixels and returns how many remain active
+	size_t retire_converged(const std::vector<double>& sums, const std::vector<double>& squares, const std::vector<int>& samples,
+		std::vector<uint8_t>& active) const;
+	// Converts summed samples into the final image
+	void resolve_image(const std::vector<color>& accumulated, const std::vector<int>& samples);
+	void render_sample_map(const std::vector<int>& samples);
+
+	// Dimensions of a sample. The pixel and the lens take the first four, then
+	// every bounce starts a block of its own, so the same decision at the same
+	// bounce draws from the same dimension in every sample of a pixel.
+	static constexpr uint32_t camera_dimensions = 4;
+	static constexpr uint32_t bounce_dimensions = 8;
+
+	sampler_settings sampling_settings;
+	// The scene's tree before it was collapsed into layout
+	std::shared_ptr<linear_bvh> scene_bvh;
 };
\ No newline at end of file
@@ -0,0 +1,211 @@
+#include "render/render.hpp"
+
+#include <array>
+
+// The wavefront backend follows many paths at once, one bounce at a time.
+// Every bounce first intersects all live paths, then groups the hits by
+// material and shades each group in a loop of its own, so a loop only ever
+// runs one scatter function.
+
+namespace {
+
+// Paths in flight per worker. Large enough for groups to fill up, small
+// enough for the paths of a batch to stay in cache.
+constexpr size_t wavefront_batch_size = 1 << 14;
+
+struct wavefront_path {
+	ray r;
+	// Fraction of light that still makes it back to the camera
+	color throughput;
+	color radiance;
+	// Density of the direction r was scattered in, 0 while it is the camera ray
+	double scatter_pdf;
+	vec3 scatter_normal;
+	// The sample's random numbers, carried from bounce to bounce
+	sampler rng;
+	// Pixel of the tile the sample belongs to
+	uint32_t pixel;
+};
+
+struct wavefront_buffers {
+	std::vector<wavefront_path> paths;
+	std::vector<hit_record> hits;
+	// Indices of the live paths, then the same grouped by material
+	std::vector<uint32_t> live;
+	std::vector<uint32_t> sorted;
+};
+
+// Shades every hit of one material. The qualified call skips the virtual
+// dispatch and lets the compiler inline scatter into the loop.
+template<typename Material>
+void shade_group(std::vector<wavefront_path>& paths, const std::vector<hit_record>& hits,
+	const uint32_t* begin, const uint32_t* end, const hittable& world, const light_list* lights,
+	const uint32_t dimension, const bool last_bounce, const bool roulette, std::vector<uint32_t>& survivors) {
+	for (const uint32_t* index = begin; index != end; index++) {
+		wavefront_path& path = paths[*index];
+		const hit_record& rec = hits[*index];
+		const auto& mat = static_cast<const Material&>(*rec.mat_ptr);
+
+		const double weight = lights ? lights->emission_weight(path.r, rec, path.scatter_pdf, path.scatter_normal) : 1;
+		path.radiance += path.throughput * mat.Material::emitted() * weight;
+
+		thread_sampler() = path.rng;
+		thread_sampler().skip_to_dimension(dimension);
+		if (lights && !last_bounce) {
+			path.radiance += path.throughput * lights->direct(world, path.r, rec);
+		}
+
+		ray scattered;
+		color attenuation;
+		bool goes_on = mat.Material::scatter(path.r, rec, attenuation, scattered);
+
+		// Light found after the last bounce would never be counted, so the path can stop here
+		if (goes_on && !last_bounce) {
+			if (lights) {
+				path.scatter_pdf = mat.Material::scatter_pdf(path.r, rec, scattered.direction);
+				path.scatter_normal = light_list::receiver_normal(rec);
+			}
+			path.throughput = path.throughput * attenuation;
+			goes_on = !roulette || survives_roulette(path.throughput);
+		}
+		else {
+			goes_on = false;
+		}
+		path.rng = thread_sampler();
+
+		if (goes_on) {
+			path.r = scattered;
+			survivors.push_back(*index);
+		}
+	}
+}
+
+}
+
+void render::generate_image_wavefront() {
+	auto start = std::chrono::high_resolution_clock::now();
+	prepare_sampling(samples_per_pixel);
+
+	std::vector<color> framebuffer(static_cast<size_t>(image_width) * image_height);
+	tile_scheduler scheduler(image_width, image_height, 16, threads);
+
+	std::cout << "Rendering " << scheduler.tile_count() << " tiles on " << scheduler.thread_count() << " threads with the wavefront backend" << std::endl;
+
+	auto progress = [&](size_t done, size_t total) {
+		auto elapsed_time = std::chrono::high_resolution_clock::now() - start;
+		auto elapsed_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed_time).count();
+
+		print_progress_bar(static_cast<double>(done), static_cast<double>(total), elapsed_time_ms);
+	};
+
+	scheduler.run([&](const tile& t) { render_tile_wavefront(t, framebuffer); }, progress);
+
+	resolve_image(framebuffer, std::vector<int>(framebuffer.size(), samples_per_pixel));
+
+	std::cerr << "\nDone.\n";
+
+	auto time = std::chrono::high_resolution_clock::now() - start;
+	auto time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(time).count();
+	std::cerr << "Image generated in " << ms_to_time(time_ms) << std::endl;
+}
+
+void render::render_tile_wavefront(const tile& t, std::vector<color>& framebuffer) {
+	// Kept per worker so the buffers are only allocated once
+	thread_local wavefront_buffers buffers;
+	auto& [paths, hits, live, sorted] = buffers;
+
+	const light_list* lights_to_sample = next_event_estimation && !lights.empty() ? &lights : nullptr;
+	const int tile_width = t.x1 - t.x0;
+	const size_t tile_pixels = static_cast<size_t>(tile_width) * (t.y1 - t.y0);
+	const size_t sample_count = tile_pixels * samples_per_pixel;
+
+	for (size_t batch_start = 0; batch_start < sample_count; batch_start += wavefront_batch_size) {
+		const size_t batch_end = std::min(sample_count, batch_start + wavefront_batch_size);
+
+		// Camera rays, samples of the same pixel next to each other
+		paths.resize(batch_end - batch_start);
+		hits.resize(paths.size());
+		live.clear();
+		for (size_t s = batch_start; s < batch_end; s++) {
+			const auto pixel = static_cast<uint32_t>(s / samples_per_pixel);
+			const int sample = static_cast<int>(s % samples_per_pixel);
+			const int i = t.x0 + static_cast<int>(pixel) % tile_width;
+			const int j = image_height - 1 - (t.y0 + static_cast<int>(pixel) / tile_width);
+
+			thread_sampler() = pixel_sampler(i, j, sample);
+			const auto [du, dv] = random_double_2d();
+			auto u = double(i + du) / (double(image_width) - 1);
+			auto v = double(j + dv) / (double(image_height) - 1);
+
+			wavefront_path& path = paths[s - batch_start];
+			path.r = cam.get_ray(u, v);
+			path.throughput = color(1, 1, 1);
+			path.radiance = color(0, 0, 0);
+			path.scatter_pdf = 0;
+			path.rng = thread_sampler();
+			path.pixel = pixel;
+			live.push_back(static_cast<uint32_t>(s - batch_start));
+		}
+
+		for (int depth = 0; depth < max_depth && !live.empty(); depth++) {
+			// Intersect everything first, paths that leave the scene pick up the background
+			std::array<uint32_t, material_kind_count + 1> group_start = {};
+			size_t hit_count = 0;
+			for (const uint32_t index : live) {
+				wavefront_path& path = paths[index];
+
+				// Participating media draw random numbers while they are intersected
+				thread_sampler() = path.rng;
+				const bool hit = world.hit(path.r, 0.001, infinity, hits[index]);
+				path.rng = thread_sampler();
+
+				if (!hit) {
+					path.radiance += path.throughput * background(path.r.direction);
+					continue;
+				}
+				live[hit_count++] = index;
+				group_start[static_cast<int>(hits[index].mat_ptr->kind) + 1]++;
+			}
+			live.resize(hit_count);
+
+			// Counting sort by material, stable so paths stay in pixel order within a group
+			for (int k = 0; k < material_kind_count; k++) {
+				group_start[k + 1] += group_start[k];
+			}
+			sorted.resize(hit_count);
+			std::array<uint32_t, material_kind_count> next = {};
+			std::copy(group_start.begin(), group_start.begin() + material_kind_count, next.begin());
+			for (const uint32_t index : live) {
+				sorted[next[static_cast<int>(hits[index].mat_ptr->kind)]++] = index;
+			}
+
+			// Survivors go back into live for the next bounce
+			live.clear();
+			const bool last_bounce = depth + 1 == max_depth;
+			const bool roulette = depth + 1 >= roulette_depth;
+			const uint32_t dimension = camera_dimensions + depth * bounce_dimensions;
+			const uint32_t* groups = sorted.data();
+			auto group = [&](material_kind kind) {
+				return std::make_pair(groups + group_start[static_cast<int>(kind)], groups + group_start[static_cast<int>(kind) + 1]);
+			};
+
+			auto [lambertian_begin, lambertian_end] = group(material_kind::lambertian);
+			shade_group<lambertian>(paths, hits, lambertian_begin, lambertian_end, world, lights_to_sample, dimension, last_bounce, roulette, live);
+			auto [metal_begin, metal_end] = group(material_kind::metal);
+			shade_group<metal>(paths, hits, metal_begin, metal_end, world, lights_to_sample, dimension, last_bounce, roulette, live);
+			auto [dielectric_begin, dielectric_end] = group(material_kind::dielectric);
+			shade_group<dielectric>(paths, hits, dielectric_begin, dielectric_end, world, lights_to_sample, dimension, last_bounce, roulette, live);
+			auto [light_begin, light_end] = group(material_kind::diffuse_light);
+			shade_group<diffuse_light>(paths, hits, light_begin, light_end, world, lights_to_sample, dimension, last_bounce, roulette, live);
+			auto [isotropic_begin, isotropic_end] = group(material_kind::isotropic);
+			shade_group<isotropic>(paths, hits, isotropic_begin, isotropic_end, world, lights_to_sample, dimension, last_bounce, roulette, live);
+		}
+
+		// Sums are added in sample order, the same way pixel_color adds them
+		for (const auto& path : paths) {
+			const int row = t.y0 + static_cast<int>(path.pixel) / tile_width;
+			const int i = t.x0 + static_cast<int>(path.pixel) % tile_width;
+			framebuffer[static_cast<size_t>(row) * image_width + i] += path.radiance;
+		}
+	}
+}
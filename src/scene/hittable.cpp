@@ -1,5 +1,39 @@
 #include "scene/hittable.hpp"
 
+packet_mask hittable::hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const {
+	packet_mask hit_mask = 0;
+
+	for (int i = 0; i < packet.count; i++) {
+		if ((active >> i & 1) && hit(packet.rays[i], t_min, hits.t_max[i], hits.rec[i])) {
+			hits.t_max[i] = hits.rec[i].t;
+			hit_mask |= packet_mask(1) << i;
+		}
+	}
+
+	return hit_mask;
+}
+
+bool hittable::occluded(const ray& r, const double t_min, const double t_max) const {
+	hit_record rec;
+	return hit(r, t_min, t_max, rec);
+}
+
+bool hittable::clipped_box(const aabb& region, aabb& output_box) const {
+	if (!bounding_box(output_box)) {
+		return false;
+	}
+
+	output_box.clip(region);
+	return !output_box.is_empty();
+}
+
+double hittable::surface_pdf(const point3& origin, const point3& p, const vec3& normal) const {
+	const vec3 to_p = p - origin;
+	const double distance_squared = to_p.length_squared();
+	const double cos_light = std::fabs(dot(normal, to_p)) / std::sqrt(distance_squared);
+	return distance_squared / (cos_light * surface_area());
+}
+
 bool translate::hit(const ray& r, const double t_min, const double t_max, hit_record& rec) const {
 	ray moved_r(r.origin - offset, r.direction);
 	
@@ -13,6 +47,24 @@ bool translate::hit(const ray& r, const double t_min, const double t_max, hit_re
 	return true;
 }
 
+packet_mask translate::hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const {
+	ray_packet moved;
+	for (int i = 0; i < packet.count; i++) {
+		moved.add(ray(packet.rays[i].origin - offset, packet.rays[i].direction));
+	}
+
+	packet_mask hit_mask = ptr->hit_packet(moved, t_min, hits, active);
+
+	for (int i = 0; i < packet.count; i++) {
+		if (hit_mask >> i & 1) {
+			hits.rec[i].p += offset;
+			hits.rec[i].set_face_normal(moved.rays[i], hits.rec[i].normal);
+		}
+	}
+
+	return hit_mask;
+}
+
 bool translate::bounding_box(aabb& output_box) const {
 	if (!ptr->bounding_box(output_box)) {
 		return false;
@@ -55,7 +107,7 @@ rotate_y::rotate_y(std::shared_ptr<hittable> p, double angle) : ptr(p) {
     bbox = aabb(min, max);
 }
 
-bool rotate_y::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+ray rotate_y::rotated(const ray& r) const {
     auto origin = r.origin;
     auto direction = r.direction;
 
@@ -65,7 +117,11 @@ bool rotate_y::hit(const ray& r, double t_min, double t_max, hit_record& rec) co
     direction[0] = cos_theta * r.direction[0] - sin_theta * r.direction[2];
     direction[2] = sin_theta * r.direction[0] + cos_theta * r.direction[2];
 
-    ray rotated_r(origin, direction);
+    return ray(origin, direction);
+}
+
+bool rotate_y::hit(const ray& r, double t_min, double t_max, hit_record& rec) const {
+    ray rotated_r = rotated(r);
 
     if (!ptr->hit(rotated_r, t_min, t_max, rec))
         return false;
@@ -85,6 +141,38 @@ bool rotate_y::hit(const ray& r, double t_min, double t_max, hit_record& rec) co
     return true;
 }
 
+packet_mask rotate_y::hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const {
+    ray_packet rotated_packet;
+    for (int i = 0; i < packet.count; i++) {
+        rotated_packet.add(rotated(packet.rays[i]));
+    }
+
+    packet_mask hit_mask = ptr->hit_packet(rotated_packet, t_min, hits, active);
+
+    for (int i = 0; i < packet.count; i++) {
+        if (!(hit_mask >> i & 1)) continue;
+
+        hit_record& rec = hits.rec[i];
+        auto p = rec.p;
+        auto normal = rec.normal;
+
+        p[0] = cos_theta * rec.p[0] + sin_theta * rec.p[2];
+        p[2] = -sin_theta * rec.p[0] + cos_theta * rec.p[2];
+
+        normal[0] = cos_theta * rec.normal[0] + sin_theta * rec.normal[2];
+        normal[2] = -sin_theta * rec.normal[0] + cos_theta * rec.normal[2];
+
+        rec.p = p;
+        rec.set_face_normal(rotated_packet.rays[i], normal);
+    }
+
+    return hit_mask;
+}
+
+bool rotate_y::occluded(const ray& r, const double t_min, const double t_max) const {
+    return ptr->occluded(rotated(r), t_min, t_max);
+}
+
 inline bool box_compare(const std::shared_ptr<hittable> a, const std::shared_ptr<hittable> b, int axis) {
     aabb box_a;
     aabb box_b;
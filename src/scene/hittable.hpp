@@ -5,11 +5,14 @@
 #include "core/ray.hpp"
 
 struct material;
+struct hittable;
 
 struct hit_record {
 	point3 p;
 	vec3 normal;
 	std::shared_ptr<material> mat_ptr;
+	// The primitive that was hit, inside whatever lists, instances or bvhs hold it
+	const hittable* object = nullptr;
 	double t = 0;
 	bool front_face = true;
 
@@ -19,9 +22,52 @@ struct hit_record {
 	}
 };
 
+// Closest hits found so far for each ray of a packet
+struct packet_hit_record {
+	std::array<hit_record, packet_size> rec;
+	// Distance to the closest hit, starts out as the far end of each ray
+	alignas(64) std::array<double, packet_size> t_max;
+};
+
 struct hittable {
 	virtual bool hit(const ray& r, const double t_min, const double t_max, hit_record& rec) const = 0;
 	virtual bool bounding_box(aabb& output_box) const = 0;
+
+	// True when anything blocks the ray between t_min and t_max. Meant for
+	// shadow and visibility rays, so it stops at the first hit it finds and
+	// fills in no hit record. By default it falls back to hit.
+	virtual bool occluded(const ray& r, const double t_min, const double t_max) const;
+
+	// Traces the active rays of a packet and updates the ones that hit closer
+	// than their t_max. Returns a mask of those rays. By default the rays are
+	// traced one at a time.
+	virtual packet_mask hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const;
+
+	// True when hit draws random numbers, like a participating medium does.
+	// Testing such an object twice for the same ray changes the result, so a
+	// bvh must never reference it from more than one leaf.
+	virtual bool random_hit() const { return false; }
+
+	// Bounds the part of the object inside region and returns false when none
+	// of it is. Spatial splits use this to cut an object's box down to one side
+	// of a plane. By default the bounding box itself is clipped.
+	virtual bool clipped_box(const aabb& region, aabb& output_box) const;
+
+	// Lets next event estimation sample an emitting object directly. Objects
+	// that support it return their surface area and material, and pick points
+	// on themselves to light origin with. The rest return an area of 0.
+	virtual double surface_area() const { return 0; }
+	virtual const material* surface_material() const { return nullptr; }
+	virtual void sample_surface(const point3& origin, point3& p, vec3& normal) const {}
+	// Density per unit of solid angle at origin of sample_surface picking p,
+	// where the normal is normal. By default points are picked uniformly by area.
+	virtual double surface_pdf(const point3& origin, const point3& p, const vec3& normal) const;
+	// Every normal sample_surface returns lies within the returned angle of
+	// axis. By default the normals may point anywhere.
+	virtual double surface_normal_bounds(vec3& axis) const {
+		axis = vec3(0, 0, 1);
+		return std::numbers::pi;
+	}
 };
 
 class translate : public hittable {
@@ -31,6 +77,11 @@ public:
 
 	virtual bool hit(const ray& r, const double t_min, const double t_max, hit_record& rec) const override;
 	virtual bool bounding_box(aabb& output_box) const override;
+	virtual packet_mask hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const override;
+	virtual bool random_hit() const override { return ptr->random_hit(); }
+	virtual bool occluded(const ray& r, const double t_min, const double t_max) const override {
+		return ptr->occluded(ray(r.origin - offset, r.direction), t_min, t_max);
+	}
 
 public:
 	std::shared_ptr<hittable> ptr;
@@ -46,6 +97,12 @@ public:
 		output_box = bbox;
 		return hasbox;
 	}
+	virtual packet_mask hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const override;
+	virtual bool random_hit() const override { return ptr->random_hit(); }
+	virtual bool occluded(const ray& r, const double t_min, const double t_max) const override;
+
+private:
+	ray rotated(const ray& r) const;
 
 public:
 std::shared_ptr<hittable> ptr;
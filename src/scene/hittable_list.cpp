@@ -16,6 +16,17 @@ bool hittable_list::hit(const ray& r, double t_min, double t_max, hit_record& re
 	return hit_anything;
 }
 
+packet_mask hittable_list::hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const {
+	// Each object only records hits closer than the ones already found
+	packet_mask hit_mask = 0;
+
+	for(const auto& object : objects) {
+		hit_mask |= object->hit_packet(packet, t_min, hits, active);
+	}
+
+	return hit_mask;
+}
+
 bool hittable_list::bounding_box(aabb& output_box) const {
 	if (objects.empty()) return false;
 
@@ -29,4 +40,12 @@ bool hittable_list::bounding_box(aabb& output_box) const {
 	}
 
 	return true;
-}
\ No newline at end of file
+}
+
+bool hittable_list::random_hit() const {
+	return std::any_of(objects.begin(), objects.end(), [](const auto& object) { return object->random_hit(); });
+}
+
+bool hittable_list::occluded(const ray& r, const double t_min, const double t_max) const {
+	return std::any_of(objects.begin(), objects.end(), [&](const auto& object) { return object->occluded(r, t_min, t_max); });
+}
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <memory>
+#include <algorithm>
 
 #include "scene/hittable.hpp"
 
@@ -16,4 +17,7 @@ struct hittable_list : hittable {
 
 	virtual bool hit(const ray& r, double t_min, double t_max, hit_record& rec) const override;
 	virtual bool bounding_box(aabb& output_box) const override;
+	virtual packet_mask hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const override;
+	virtual bool random_hit() const override;
+	virtual bool occluded(const ray& r, const double t_min, const double t_max) const override;
 };
\ No newline at end of file
@@ -0,0 +1,90 @@
+#include "scene/instance.hpp"
+
+instance::instance(std::shared_ptr<hittable> p, const transform& placement)
+	: object(p), object_to_world(placement) {
+	aabb local;
+	hasbox = object->bounding_box(local);
+
+	// Bound all eight corners of the object's box once they are moved into the world
+	bbox = aabb::empty();
+	for (int corner = 0; corner < 8; corner++) {
+		point3 p(
+			corner & 1 ? local.max().x() : local.min().x(),
+			corner & 2 ? local.max().y() : local.min().y(),
+			corner & 4 ? local.max().z() : local.min().z()
+		);
+		bbox.expand(object_to_world.point(p));
+	}
+}
+
+bool instance::hit(const ray& r, const double t_min, const double t_max, hit_record& rec) const {
+	// The direction is not normalised again, so distances along the ray are the
+	// same in both spaces and t needs no conversion
+	ray local(object_to_world.inverse_point(r.origin), object_to_world.inverse_vector(r.direction));
+
+	if (!object->hit(local, t_min, t_max, rec)) {
+		return false;
+	}
+
+	// An affine transform keeps the normal on the same side of the ray, so
+	// front_face carries over as is
+	rec.p = object_to_world.point(rec.p);
+	rec.normal = unit_vector(object_to_world.normal(rec.normal));
+
+	return true;
+}
+
+packet_mask instance::hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const {
+	ray_packet local;
+	for (int i = 0; i < packet.count; i++) {
+		local.add(ray(object_to_world.inverse_point(packet.rays[i].origin), object_to_world.inverse_vector(packet.rays[i].direction)));
+	}
+
+	packet_mask hit_mask = object->hit_packet(local, t_min, hits, active);
+
+	for (int i = 0; i < packet.count; i++) {
+		if (hit_mask >> i & 1) {
+			hits.rec[i].p = object_to_world.point(hits.rec[i].p);
+			hits.rec[i].normal = unit_vector(object_to_world.normal(hits.rec[i].normal));
+		}
+	}
+
+	return hit_mask;
+}
+
+bool instance::occluded(const ray& r, const double t_min, const double t_max) const {
+	return object->occluded(ray(object_to_world.inverse_point(r.origin), object_to_world.inverse_vector(r.direction)), t_min, t_max);
+}
+
+bool instance::clipped_box(const aabb& region, aabb& output_box) const {
+	// Clip the object against the region's bounds in object space, then bound
+	// that piece back in the world. Both steps only ever grow the box, so the
+	// result is loose but never misses any of the object.
+	aabb local_region = aabb::empty();
+	for (int corner = 0; corner < 8; corner++) {
+		point3 p(
+			corner & 1 ? region.max().x() : region.min().x(),
+			corner & 2 ? region.max().y() : region.min().y(),
+			corner & 4 ? region.max().z() : region.min().z()
+		);
+		local_region.expand(object_to_world.inverse_point(p));
+	}
+
+	aabb local;
+	if (!object->clipped_box(local_region, local)) {
+		return false;
+	}
+
+	output_box = aabb::empty();
+	for (int corner = 0; corner < 8; corner++) {
+		point3 p(
+			corner & 1 ? local.max().x() : local.min().x(),
+			corner & 2 ? local.max().y() : local.min().y(),
+			corner & 4 ? local.max().z() : local.min().z()
+		);
+		output_box.expand(object_to_world.point(p));
+	}
+
+	output_box.clip(region);
+	return !output_box.is_empty();
+}
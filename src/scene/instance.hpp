@@ -0,0 +1,32 @@
+#pragma once
+
+#include <memory>
+
+#include "core/transform.hpp"
+#include "scene/hittable.hpp"
+
+// Places a shared object, usually a whole bvh, in the scene with an affine
+// transform. The ray is moved into object space once per instance instead of
+// once per wrapper, and the object itself is never copied, so any number of
+// instances can share one bottom level bvh.
+class instance : public hittable {
+public:
+	instance(std::shared_ptr<hittable> p, const transform& placement);
+
+	virtual bool hit(const ray& r, const double t_min, const double t_max, hit_record& rec) const override;
+	virtual bool bounding_box(aabb& output_box) const override {
+		output_box = bbox;
+		return hasbox;
+	}
+	virtual packet_mask hit_packet(const ray_packet& packet, const double t_min, packet_hit_record& hits, packet_mask active) const override;
+	virtual bool random_hit() const override { return object->random_hit(); }
+	virtual bool clipped_box(const aabb& region, aabb& output_box) const override;
+	virtual bool occluded(const ray& r, const double t_min, const double t_max) const override;
+
+public:
+	std::shared_ptr<hittable> object;
+	// Holds the way back into object space as well
+	transform object_to_world;
+	bool hasbox;
+	aabb bbox;
+};
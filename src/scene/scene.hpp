@@ -1,13 +1,24 @@
 #pragma once
 
 #include <tuple>
+#include <string>
+#include <numbers>
+#include <cmath>
+#include <algorithm>
 
+#include "acceleration/bvh.hpp"
+#include "acceleration/linear_bvh.hpp"
 #include "scene/hittable_list.hpp"
+#include "scene/instance.hpp"
 #include "camera/camera.hpp"
+#include "core/transform.hpp"
 #include "core/color.hpp"
 #include "geometry/sphere.hpp"
 #include "geometry/aa_rect.hpp"
 #include "geometry/box.hpp"
+#include "geometry/box_set.hpp"
+#include "geometry/triangle_mesh.hpp"
+#include "geometry/mesh_loader.hpp"
 #include "volumes/constant_medium.hpp"
 #include "materials/material.hpp"
 
@@ -17,6 +28,11 @@ public:
 	// each function returns a hittable_list world and a camera cam
 	// all functions are static
 
+	// Model placed in mesh_cornell_box, an .obj or .ply file
+	static inline std::string mesh_path = "assets/models/bunny.obj";
+	// Built bvhs are kept here so later runs of the same scene skip the build, empty turns that off
+	static inline std::string bvh_cache_directory = "bvh_cache";
+
 	static std::tuple<hittable_list, camera, std::function<color(const vec3&)>> simple_light(double aspect_ratio) {
 
 		hittable_list objects;
@@ -206,16 +222,12 @@ public:
 
 		objects.add(std::make_shared<xy_rect>(0, 555, 0, 555, 555, white));
 
-		// Two boxes withing the cornell box
-		std::shared_ptr<hittable> box1 = std::make_shared<box>(point3(0, 0, 0), point3(165, 330, 165), white);
-		box1 = std::make_shared<rotate_y>(box1, 15);
-		box1 = std::make_shared<translate>(box1, vec3(265, 0, 295));
-		objects.add(box1);
-
-		std::shared_ptr<hittable> box2 = std::make_shared<box>(point3(0, 0, 0), point3(165, 165, 165), white);
-		box2 = std::make_shared<rotate_y>(box2, -18);
-		box2 = std::make_shared<translate>(box2, vec3(130, 0, 65));
-		objects.add(box2);
+		// Two boxes withing the cornell box, both instances of the same unit cube
+		auto cube = std::make_shared<box>(point3(0, 0, 0), point3(1, 1, 1), white);
+		objects.add(std::make_shared<instance>(cube,
+			transform::translation(vec3(265, 0, 295)) * transform::rotation_y(15) * transform::scaling(vec3(165, 330, 165))));
+		objects.add(std::make_shared<instance>(cube,
+			transform::translation(vec3(130, 0, 65)) * transform::rotation_y(-18) * transform::scaling(vec3(165, 165, 165))));
 
 		// Camera setup
 		point3 lookfrom(278, 278, -800);
@@ -252,14 +264,12 @@ public:
 
 		objects.add(std::make_shared<xy_rect>(0, 555, 0, 555, 555, white));
 
-		// Two boxes within the cornell box
-		std::shared_ptr<hittable> box1 = std::make_shared<box>(point3(0, 0, 0), point3(165, 330, 165), white);
-		box1 = std::make_shared<rotate_y>(box1, 15);
-		box1 = std::make_shared<translate>(box1, vec3(265, 0, 295));
-
-		std::shared_ptr<hittable> box2 = std::make_shared<box>(point3(0, 0, 0), point3(165, 165, 165), white);
-		box2 = std::make_shared<rotate_y>(box2, -18);
-		box2 = std::make_shared<translate>(box2, vec3(130, 0, 65));
+		// Two boxes within the cornell box, both instances of the same unit cube
+		auto cube = std::make_shared<box>(point3(0, 0, 0), point3(1, 1, 1), white);
+		auto box1 = std::make_shared<instance>(cube,
+			transform::translation(vec3(265, 0, 295)) * transform::rotation_y(15) * transform::scaling(vec3(165, 330, 165)));
+		auto box2 = std::make_shared<instance>(cube,
+			transform::translation(vec3(130, 0, 65)) * transform::rotation_y(-18) * transform::scaling(vec3(165, 165, 165)));
 
 		objects.add(make_shared<constant_medium>(box1, 0.01, color(0, 0, 0)));
 		objects.add(make_shared<constant_medium>(box2, 0.01, color(1, 1, 1)));
@@ -285,6 +295,9 @@ public:
 		hittable_list objects;
 		auto ground = std::make_shared<lambertian>(color(0.48, 0.83, 0.53));
 
+		// The ground boxes go into one box_set, which tests them eight at a time
+		std::vector<box> ground_boxes;
+
 		const int boxes_per_side = 20;
 		for (int i = 0; i < boxes_per_side; i++) {
 			for (int j = 0; j < boxes_per_side; j++) {
@@ -296,9 +309,10 @@ public:
 				auto y1 = random_double(1, 101);
 				auto z1 = z0 + w;
 
-				objects.add(std::make_shared<box>(point3(x0, y0, z0), point3(x1, y1, z1), ground));
+				ground_boxes.emplace_back(point3(x0, y0, z0), point3(x1, y1, z1), ground);
 			}
 		}
+		objects.add(std::make_shared<box_set>(ground_boxes));
 
 		auto light = std::make_shared<diffuse_light>(color(7, 7, 7));
 		objects.add(std::make_shared<xz_rect>(123, 423, 147, 412, 554, light));
@@ -329,12 +343,9 @@ public:
 			boxes2.add(std::make_shared<sphere>(point3::random(0, 165), 10, white));
 		}
 
-		objects.add(std::make_shared<translate>(
-			std::make_shared<rotate_y>(
-				std::make_shared<bvh_node>(boxes2), 15),
-				vec3(-100, 270, 395)
-			)
-		);
+		// The cluster gets its own bvh and sits in the scene as a single instance
+		objects.add(std::make_shared<instance>(std::make_shared<linear_bvh>(boxes2),
+			transform::translation(vec3(-100, 270, 395)) * transform::rotation_y(15)));
 
 		// Camera setup
 		point3 lookfrom(478, 278, -600);
@@ -352,4 +363,84 @@ public:
 
 		return std::make_tuple(objects, cam, background);
 	}
+
+	// A cornell box around the model at mesh_path, scaled to stand 250 units tall
+	// on the floor. Falls back to a torus when the model can't be loaded.
+	static std::tuple<hittable_list, camera, std::function<color(const vec3&)>> mesh_cornell_box(double aspect_ratio) {
+		hittable_list objects;
+
+		auto red = std::make_shared<lambertian>(color(.65, .05, .05));
+		auto white = std::make_shared<lambertian>(color(.73, .73, .73));
+		auto green = std::make_shared<lambertian>(color(.12, .45, .15));
+		auto light = std::make_shared<diffuse_light>(color(15, 15, 15));
+
+		// Walls of the cornell box
+		objects.add(std::make_shared<yz_rect>(0, 555, 0, 555, 555, green));
+		objects.add(std::make_shared<yz_rect>(0, 555, 0, 555, 0, red));
+
+		objects.add(std::make_shared<xz_rect>(213, 343, 227, 332, 554, light));
+		objects.add(std::make_shared<xz_rect>(0, 555, 0, 555, 0, white));
+		objects.add(std::make_shared<xz_rect>(0, 555, 0, 555, 555, white));
+
+		objects.add(std::make_shared<xy_rect>(0, 555, 0, 555, 555, white));
+
+		bvh_build_options mesh_options;
+		mesh_options.cache_directory = bvh_cache_directory;
+		std::shared_ptr<triangle_mesh> mesh = load_mesh(mesh_path, white, mesh_options);
+		if (!mesh) {
+			std::cerr << "Using a torus in place of " << mesh_path << ".\n";
+			mesh = torus(1.0, 0.4, 256, 128, white);
+		}
+
+		// Fit the model into the box whatever units it was made in
+		aabb bounds;
+		mesh->bounding_box(bounds);
+		const vec3 extent = bounds.max() - bounds.min();
+		const double scale = 250.0 / std::max({ extent.x(), extent.y(), extent.z(), 1e-8 });
+		const point3 center = bounds.center();
+		objects.add(std::make_shared<instance>(mesh,
+			transform::translation(vec3(278 - center.x() * scale, -bounds.min().y() * scale, 278 - center.z() * scale))
+			* transform::scaling(vec3(scale, scale, scale))));
+
+		// Camera setup
+		point3 lookfrom(278, 278, -800);
+		point3 lookat(278, 278, 0);
+		vec3 vup(0, 1, 0);
+		double dist_to_focus = 10.0;
+		double aperture = 0.0;
+
+		camera cam(lookfrom, lookat, vup, 40, aspect_ratio, aperture, dist_to_focus);
+
+		// Background color
+		auto background = [](const vec3& d) -> color {
+			return color(0, 0, 0);
+		};
+
+		return std::make_tuple(objects, cam, background);
+	}
+
+	// A torus around the y axis, tessellated into rings * sides quads
+	static std::shared_ptr<triangle_mesh> torus(double major_radius, double minor_radius, int rings, int sides, std::shared_ptr<material> m) {
+		std::array<std::vector<double>, 3> positions;
+		std::vector<uint32_t> indices;
+
+		for (int i = 0; i < rings; i++) {
+			const double u = 2 * std::numbers::pi * i / rings;
+			for (int j = 0; j < sides; j++) {
+				const double v = 2 * std::numbers::pi * j / sides;
+				const double radius = major_radius + minor_radius * std::cos(v);
+				positions[0].push_back(radius * std::cos(u));
+				positions[1].push_back(minor_radius * std::sin(v));
+				positions[2].push_back(radius * std::sin(u));
+
+				const uint32_t a = i * sides + j;
+				const uint32_t b = ((i + 1) % rings) * sides + j;
+				const uint32_t c = ((i + 1) % rings) * sides + (j + 1) % sides;
+				const uint32_t d = i * sides + (j + 1) % sides;
+				indices.insert(indices.end(), { a, b, c, a, c, d });
+			}
+		}
+
+		return std::make_shared<triangle_mesh>(std::move(positions), std::move(indices), m);
+	}
 };
\ No newline at end of file
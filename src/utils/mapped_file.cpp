@@ -0,0 +1,107 @@
+#include "utils/mapped_file.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+mapped_file::mapped_file(const std::string& path) {
+	HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return;
+	}
+	file = handle;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(handle, &file_size)) {
+		close();
+		return;
+	}
+	size = static_cast<size_t>(file_size.QuadPart);
+	opened = true;
+
+	// Empty files can't be mapped, they are simply open with no contents
+	if (size == 0) {
+		return;
+	}
+
+	mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping != nullptr) {
+		data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+	if (data == nullptr) {
+		close();
+	}
+}
+
+void mapped_file::close() {
+	if (data != nullptr) {
+		UnmapViewOfFile(data);
+	}
+	if (mapping != nullptr) {
+		CloseHandle(mapping);
+	}
+	if (file != nullptr) {
+		CloseHandle(file);
+	}
+	data = nullptr;
+	mapping = nullptr;
+	file = nullptr;
+	size = 0;
+	opened = false;
+}
+
+#else
+
+mapped_file::mapped_file(const std::string& path) {
+	const int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) == 0) {
+		size = static_cast<size_t>(info.st_size);
+		opened = true;
+
+		// Empty files can't be mapped, they are simply open with no contents
+		if (size > 0) {
+			void* address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (address != MAP_FAILED) {
+				// The loaders read front to back
+				madvise(address, size, MADV_SEQUENTIAL);
+				data = static_cast<const char*>(address);
+			}
+			else {
+				size = 0;
+				opened = false;
+			}
+		}
+	}
+
+	// The mapping stays valid after the descriptor is closed
+	::close(fd);
+}
+
+void mapped_file::close() {
+	if (data != nullptr) {
+		munmap(const_cast<char*>(data), size);
+	}
+	data = nullptr;
+	size = 0;
+	opened = false;
+}
+
+#endif
+
+mapped_file::~mapped_file() {
+	close();
+}
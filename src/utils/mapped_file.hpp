@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// A read only view of a whole file mapped into memory. The operating system
+// pages the contents in as they are read, so nothing is copied up front.
+class mapped_file {
+public:
+	mapped_file() = default;
+	explicit mapped_file(const std::string& path);
+	~mapped_file();
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	// False when the file couldn't be opened or mapped
+	bool is_open() const { return opened; }
+
+	std::string_view contents() const { return { data, size }; }
+
+private:
+	void close();
+
+	const char* data = nullptr;
+	size_t size = 0;
+	bool opened = false;
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#endif
+};
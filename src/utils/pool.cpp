@@ -1,7 +1,11 @@
 #include "utils/pool.hpp"
 
 pool::pool() {
-	num_threads = static_cast<int>(std::thread::hardware_concurrency() / 1.5);
+	num_threads = default_thread_count();
+}
+
+int pool::default_thread_count() {
+	return std::max(1, static_cast<int>(std::thread::hardware_concurrency() / 1.5));
 }
 
 void pool::start_pool() {
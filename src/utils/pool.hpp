@@ -1,5 +1,8 @@
+#pragma once
+
 #include <vector>
 #include <thread>
+#include <algorithm>
 #include <functional>
 #include <queue>
 #include <mutex>
@@ -20,6 +23,9 @@ struct pool {
 
 	pool();
 
+	// Leaves some cores free for the rest of the system, but always at least one thread
+	static int default_thread_count();
+
 	void start_pool();
 	void join_threads();
 	void run_tasks();
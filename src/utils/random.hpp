@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+
+// PCG32 by Melissa O'Neill: 64 bits of state, 32 bit outputs. Much smaller and
+// faster than mt19937 and still passes the usual statistical test suites.
+// Generators on different streams produce independent sequences.
+class pcg32 {
+public:
+	static constexpr uint64_t default_state = 0x853c49e6748fea9bULL;
+	static constexpr uint64_t default_stream = 0xda3e39cb94b95bdbULL;
+
+	pcg32() { seed(default_state, default_stream); }
+	pcg32(const uint64_t initial_state, const uint64_t stream) { seed(initial_state, stream); }
+
+	void seed(const uint64_t initial_state, const uint64_t stream = default_stream) {
+		state = 0;
+		increment = (stream << 1) | 1;
+		next_uint();
+		state += initial_state;
+		next_uint();
+	}
+
+	uint32_t next_uint() {
+		const uint64_t old = state;
+		state = old * 6364136223846793005ULL + increment;
+		const auto xorshifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+		const auto rotation = static_cast<uint32_t>(old >> 59);
+		return (xorshifted >> rotation) | (xorshifted << ((~rotation + 1) & 31));
+	}
+
+	// Uniform in [0,1), 32 bits of resolution are plenty for sampling
+	double next_double() {
+		return next_uint() * 0x1p-32;
+	}
+
+private:
+	uint64_t state;
+	uint64_t increment;
+};
+
+// SplitMix64 finalizer, spreads nearby values like pixel indices over the
+// whole range so they make good seeds
+inline constexpr uint64_t mix_seed(uint64_t x) {
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
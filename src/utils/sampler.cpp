@@ -0,0 +1,163 @@
+#include "utils/sampler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <iostream>
+
+// The scrambling follows Burley, "Practical Hash-based Owen Scrambling"
+// (JCGT 2020), the blue noise ordering Ahmed and Wonka, "Screen-Space
+// Blue-Noise Diffusion of Monte Carlo Sampling Error via Hierarchical
+// Ordering of Pixels" (SIGGRAPH Asia 2020).
+
+namespace {
+
+uint32_t reverse_bits(uint32_t x) {
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+	x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+// A random permutation in which every bit only depends on itself and the
+// bits below it, Owen scrambling once the bits are reversed
+uint32_t laine_karras_permutation(uint32_t x, const uint32_t seed) {
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return x;
+}
+
+uint32_t owen_scramble(const uint32_t x, const uint32_t seed) {
+	return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+}
+
+// The first two dimensions of the Sobol sequence, as 32 bit fractions. The
+// first is the van der Corput sequence, the second has the generator matrix
+// that xors every direction into the next one shifted down by one.
+uint32_t sobol_first(const uint32_t index) {
+	return reverse_bits(index);
+}
+
+// The directions of the second dimension summed up for every value of every
+// byte of the index. Scrambled indices use all 32 bits, so going bit by bit
+// would take 32 steps.
+constexpr auto sobol_second_bytes = [] {
+	std::array<std::array<uint32_t, 256>, 4> bytes = {};
+	uint32_t direction = 0x80000000u;
+	for (int bit = 0; bit < 32; bit++, direction ^= direction >> 1) {
+		for (uint32_t value = 0; value < 256; value++) {
+			if (value >> (bit % 8) & 1) {
+				bytes[bit / 8][value] ^= direction;
+			}
+		}
+	}
+	return bytes;
+}();
+
+uint32_t sobol_second(const uint32_t index) {
+	return sobol_second_bytes[0][index & 0xff] ^ sobol_second_bytes[1][(index >> 8) & 0xff]
+		^ sobol_second_bytes[2][(index >> 16) & 0xff] ^ sobol_second_bytes[3][index >> 24];
+}
+
+uint64_t spread_bits(uint64_t x) {
+	x &= 0xffffffffull;
+	x = (x | (x << 16)) & 0x0000ffff0000ffffull;
+	x = (x | (x << 8)) & 0x00ff00ff00ff00ffull;
+	x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0full;
+	x = (x | (x << 2)) & 0x3333333333333333ull;
+	return (x | (x << 1)) & 0x5555555555555555ull;
+}
+
+uint64_t morton(const int x, const int y) {
+	return spread_bits(static_cast<uint64_t>(x)) | (spread_bits(static_cast<uint64_t>(y)) << 1);
+}
+
+int log2_ceil(const int x) {
+	return x <= 1 ? 0 : std::bit_width(static_cast<uint32_t>(x - 1));
+}
+
+}
+
+void sampler_settings::fit(const int width, const int height, const int max_samples) {
+	log2_resolution = log2_ceil(std::max(width, height));
+	log2_samples = log2_ceil(max_samples);
+
+	if (type == sampler_type::blue_noise && 2 * log2_resolution + log2_samples > 32) {
+		std::cerr << "Too many samples for the blue noise sampler, using sobol instead.\n";
+		type = sampler_type::sobol;
+	}
+}
+
+sampler::sampler(const sampler_settings& settings, const int x, const int y, const uint32_t sample, const pcg32& generator)
+	: rng(generator), type(settings.type) {
+	if (type == sampler_type::sobol) {
+		seed = mix_seed(settings.seed ^ morton(x, y));
+		index = sample;
+	}
+	else if (type == sampler_type::blue_noise) {
+		seed = mix_seed(settings.seed);
+		index = (morton(x, y) << settings.log2_samples) | sample;
+		log2_samples = settings.log2_samples;
+		base4_digits = settings.log2_resolution + (settings.log2_samples + 1) / 2;
+	}
+}
+
+uint32_t sampler::sequence_index() const {
+	if (type == sampler_type::sobol) {
+		// Shuffling the order of the samples for every dimension decorrelates
+		// the dimensions while every power of two prefix stays stratified
+		return owen_scramble(static_cast<uint32_t>(index), static_cast<uint32_t>(mix_seed(seed ^ dimension)));
+	}
+
+	// Walks down the pixel quadtree two levels at a time and shuffles the four
+	// quadrants under every node, so each pixel gets its own run of samples
+	// and neighbours cover for each other. Odd sample counts leave a last
+	// level of two.
+	static constexpr uint8_t permutations[24][4] = {
+		{ 0, 1, 2, 3 }, { 0, 1, 3, 2 }, { 0, 2, 1, 3 }, { 0, 2, 3, 1 }, { 0, 3, 2, 1 }, { 0, 3, 1, 2 },
+		{ 1, 0, 2, 3 }, { 1, 0, 3, 2 }, { 1, 2, 0, 3 }, { 1, 2, 3, 0 }, { 1, 3, 2, 0 }, { 1, 3, 0, 2 },
+		{ 2, 1, 0, 3 }, { 2, 1, 3, 0 }, { 2, 0, 1, 3 }, { 2, 0, 3, 1 }, { 2, 3, 0, 1 }, { 2, 3, 1, 0 },
+		{ 3, 1, 2, 0 }, { 3, 1, 0, 2 }, { 3, 2, 1, 0 }, { 3, 2, 0, 1 }, { 3, 0, 2, 1 }, { 3, 0, 1, 2 }
+	};
+
+	const bool odd = log2_samples & 1;
+	uint64_t shuffled = 0;
+	for (int digit = base4_digits - 1; digit >= (odd ? 1 : 0); digit--) {
+		const int shift = 2 * digit - (odd ? 1 : 0);
+		const uint64_t quadrant = (index >> shift) & 3;
+		const uint64_t above = index >> (shift + 2);
+		const uint64_t permutation = (mix_seed(above ^ (0x55555555ull * dimension)) >> 24) % 24;
+		shuffled |= static_cast<uint64_t>(permutations[permutation][quadrant]) << shift;
+	}
+	if (odd) {
+		shuffled |= (index & 1) ^ (mix_seed((index >> 1) ^ (0x55555555ull * dimension)) & 1);
+	}
+	return static_cast<uint32_t>(shuffled);
+}
+
+double sampler::sobol_1d() {
+	const uint32_t i = sequence_index();
+	const uint64_t hash = mix_seed(seed ^ (static_cast<uint64_t>(dimension) << 32));
+	dimension++;
+	return owen_scramble(sobol_first(i), static_cast<uint32_t>(hash)) * 0x1p-32;
+}
+
+std::array<double, 2> sampler::sobol_2d() {
+	const uint32_t i = sequence_index();
+	const uint64_t hash = mix_seed(seed ^ (static_cast<uint64_t>(dimension) << 32));
+	dimension += 2;
+	return {
+		owen_scramble(sobol_first(i), static_cast<uint32_t>(hash)) * 0x1p-32,
+		owen_scramble(sobol_second(i), static_cast<uint32_t>(hash >> 32)) * 0x1p-32
+	};
+}
+
+sampler& thread_sampler() {
+	static std::atomic<uint64_t> next_stream{0};
+	thread_local sampler current(pcg32(pcg32::default_state, next_stream++));
+	return current;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "utils/random.hpp"
+
+// Where the random numbers of a sample come from
+enum class sampler_type {
+	// White noise from the sample's pcg32 stream
+	independent,
+	// Owen scrambled Sobol points, scrambled differently for every pixel
+	sobol,
+	// One Owen scrambled Sobol sequence for the whole image, dealt out to the
+	// pixels along a Morton curve, so neighbouring pixels get samples that
+	// complement each other and what noise remains looks like blue noise
+	blue_noise
+};
+
+// What the samplers of a render have in common
+struct sampler_settings {
+	sampler_type type = sampler_type::sobol;
+	uint64_t seed = 0;
+	// Base 2 logarithms of the image size and of the samples per pixel, rounded up
+	int log2_resolution = 0;
+	int log2_samples = 0;
+
+	// Sizes the settings for an image. The blue noise sampler numbers the
+	// samples of the whole image with 32 bits and falls back to sobol for
+	// images and sample counts too large for that.
+	void fit(const int width, const int height, const int max_samples);
+};
+
+// Hands out the random numbers of one sample of one pixel, one dimension at a
+// time. Pairs that belong together, like a point on the lens or a direction,
+// come from get_2d so they are stratified together. Every number of a sample
+// comes from a dimension of its own, so they never depend on each other.
+class sampler {
+public:
+	// An independent sampler, for everything outside of rendering
+	sampler() = default;
+	explicit sampler(const pcg32& generator) : rng(generator) {}
+	sampler(const sampler_settings& settings, const int x, const int y, const uint32_t sample, const pcg32& generator);
+
+	double get_1d() {
+		if (type == sampler_type::independent) {
+			return rng.next_double();
+		}
+		return sobol_1d();
+	}
+
+	std::array<double, 2> get_2d() {
+		if (type == sampler_type::independent) {
+			const double u = rng.next_double();
+			return { u, rng.next_double() };
+		}
+		return sobol_2d();
+	}
+
+	// Moves on to dimension d, so the samples of a pixel use the same
+	// dimensions for the same decisions even after their paths differed.
+	// Never moves back, a dimension is only ever used once.
+	void skip_to_dimension(const uint32_t d) {
+		if (d > dimension) {
+			dimension = d;
+		}
+	}
+
+private:
+	double sobol_1d();
+	std::array<double, 2> sobol_2d();
+	// Index of the sample in the Sobol sequence for the current dimension
+	uint32_t sequence_index() const;
+
+	pcg32 rng;
+	sampler_type type = sampler_type::independent;
+	uint32_t dimension = 0;
+	uint64_t seed = 0;
+	// The sample for sobol, the pixel's Morton index followed by the sample for blue noise
+	uint64_t index = 0;
+	int log2_samples = 0;
+	int base4_digits = 0;
+};
+
+// The sampler of the calling thread. It starts out independent, on a pcg32
+// stream of its own for each thread.
+sampler& thread_sampler();
@@ -0,0 +1,73 @@
+#include "utils/tile_scheduler.hpp"
+
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include "utils/pool.hpp"
+
+tile_scheduler::tile_scheduler(int width, int height, int tile_size, int threads)
+	: num_threads(threads > 0 ? threads : pool::default_thread_count()), queues(num_threads) {
+	tile_size = std::max(1, tile_size);
+	for (int y = 0; y < height; y += tile_size) {
+		for (int x = 0; x < width; x += tile_size) {
+			tiles.push_back({ x, y, std::min(x + tile_size, width), std::min(y + tile_size, height) });
+		}
+	}
+}
+
+void tile_scheduler::run(const std::function<void(const tile&)>& render_tile, const std::function<void(size_t done, size_t total)>& progress) {
+	// Tiles are dealt out in turn, so every worker gets some of each part of
+	// the image and the progress reported stays a good estimate of the time left
+	for (size_t i = 0; i < tiles.size(); i++) {
+		queues[i % num_threads].tiles.push_back(tiles[i]);
+	}
+	finished_tiles = 0;
+
+	std::vector<std::thread> workers;
+	for (int w = 0; w < num_threads; w++) {
+		workers.emplace_back([this, w, &render_tile]() {
+			tile t;
+			while (next_tile(w, t)) {
+				render_tile(t);
+				finished_tiles++;
+			}
+		});
+	}
+
+	if (progress) {
+		while (finished_tiles.load() < tiles.size()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			progress(finished_tiles.load(), tiles.size());
+		}
+	}
+
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+bool tile_scheduler::next_tile(int worker, tile& out) {
+	{
+		std::lock_guard<std::mutex> l(queues[worker].m);
+		if (!queues[worker].tiles.empty()) {
+			out = queues[worker].tiles.front();
+			queues[worker].tiles.pop_front();
+			return true;
+		}
+	}
+
+	// Steal from the back, the tiles the owner would get to last
+	for (int offset = 1; offset < num_threads; offset++) {
+		worker_queue& victim = queues[(worker + offset) % num_threads];
+		std::lock_guard<std::mutex> l(victim.m);
+		if (!victim.tiles.empty()) {
+			out = victim.tiles.back();
+			victim.tiles.pop_back();
+			return true;
+		}
+	}
+
+	// Nothing is ever added once running, so empty queues stay empty
+	return false;
+}
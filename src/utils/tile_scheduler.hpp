@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstddef>
+
+// A rectangle of pixels rendered as one piece of work, x1 and y1 are exclusive
+struct tile {
+	int x0, y0;
+	int x1, y1;
+};
+
+// Splits an image into tiles and renders them on worker threads. Every worker
+// owns a deque of tiles and takes work from its front. A worker that runs dry
+// steals from the back of another worker's deque, so the locks are almost
+// never contended and nothing is allocated per pixel.
+class tile_scheduler {
+public:
+	// 0 threads picks the pool default
+	tile_scheduler(int width, int height, int tile_size = 16, int threads = 0);
+
+	size_t tile_count() const { return tiles.size(); }
+	int thread_count() const { return num_threads; }
+
+	// Calls render_tile once for every tile on the workers and returns when all
+	// are done. Meanwhile progress gets the number of finished tiles every 100ms
+	// on the calling thread.
+	void run(const std::function<void(const tile&)>& render_tile, const std::function<void(size_t done, size_t total)>& progress = {});
+
+private:
+	// Padded to a cache line so workers locking their own queue don't slow each other down
+	struct alignas(64) worker_queue {
+		std::mutex m;
+		std::deque<tile> tiles;
+	};
+
+	// Own queue first, then the others. False once every queue is empty.
+	bool next_tile(int worker, tile& out);
+
+	int num_threads;
+	std::vector<tile> tiles;
+	std::vector<worker_queue> queues;
+	std::atomic<size_t> finished_tiles{0};
+};
@@ -3,7 +3,6 @@
 #include <cmath>
 #include <limits>
 #include <memory>
-#include <random>
 #include <string>
 #include <iostream>
 #include <iomanip>
@@ -12,6 +11,8 @@
 #include <cstdint>
 #include <numbers>
 
+#include "utils/sampler.hpp"
+
 //Constants
 constexpr double infinity = std::numeric_limits<double>::infinity();
 
@@ -28,12 +29,13 @@ inline constexpr double clamp(const double x, const double min, const double max
 
 //Random
 inline double random_double() {
-	// return rand() / (RAND_MAX + 1.0);
+	// Every thread has a sampler of its own, so there is no shared state to fight over
+	return thread_sampler().get_1d();
+}
 
-	// this is a better random but is much slower
-	static std::uniform_real_distribution<double> distribution(0, 1);
-	static std::mt19937 generator;
-	return distribution(generator);
+// Two numbers that belong together, like the coordinates of a point
+inline std::array<double, 2> random_double_2d() {
+	return thread_sampler().get_2d();
 }
 
 inline double random_double(const double min, const double max) {
@@ -5,14 +5,32 @@ bool constant_medium::hit(const ray& r, double t_min, double t_max, hit_record&
     const bool enableDebug = false;
     const bool debugging = enableDebug && random_double() < 0.00001;
 
+    if (!sample_scatter(r, t_min, t_max, rec.t)) return false;
+
+    rec.p = r.at(rec.t);
+
+    if (debugging) std::cerr << "rec.t = " << rec.t << '\n' << "rec.p = " << rec.p << '\n';
+
+    rec.normal = vec3(1, 0, 0);  // arbitrary
+    rec.front_face = true;     // also arbitrary
+    rec.mat_ptr = phase_function;
+    rec.object = this;
+
+    return true;
+}
+
+bool constant_medium::occluded(const ray& r, double t_min, double t_max) const {
+    double t;
+    return sample_scatter(r, t_min, t_max, t);
+}
+
+bool constant_medium::sample_scatter(const ray& r, double t_min, double t_max, double& t) const {
     hit_record rec1, rec2;
 
     if (!boundary->hit(r, -infinity, infinity, rec1)) return false;
 
     if (!boundary->hit(r, rec1.t + 0.0001, infinity, rec2)) return false;
 
-    if (debugging) std::cerr << "\nt_min=" << rec1.t << ", t_max=" << rec2.t << '\n';
-
     rec1.t = std::max(rec1.t, t_min);
     rec2.t = std::min(rec2.t, t_max);
 
@@ -26,14 +44,7 @@ bool constant_medium::hit(const ray& r, double t_min, double t_max, hit_record&
 
     if (hit_distance > distance_inside_boundary) return false;
 
-    rec.t = rec1.t + hit_distance / ray_length;
-    rec.p = r.at(rec.t);
-
-    if (debugging) std::cerr << "hit_distance = " << hit_distance << '\n' << "rec.t = " << rec.t << '\n' << "rec.p = " << rec.p << '\n';
-
-    rec.normal = vec3(1, 0, 0);  // arbitrary
-    rec.front_face = true;     // also arbitrary
-    rec.mat_ptr = phase_function;
+    t = rec1.t + hit_distance / ray_length;
 
     return true;
-}
\ No newline at end of file
+}
@@ -14,6 +14,17 @@ public:
         return boundary->bounding_box(output_box);
     }
 
+    // Where the ray scatters is drawn at random on every test
+    virtual bool random_hit() const override { return true; }
+
+    // Blocks the ray wherever it would have scattered, so on average a shadow
+    // ray gets through as often as the medium lets light through
+    virtual bool occluded(const ray& r, double t_min, double t_max) const override;
+
+private:
+    // Draws how far into the medium the ray scatters and writes the distance
+    // along the ray, false when it makes it through
+    bool sample_scatter(const ray& r, double t_min, double t_max, double& t) const;
 
 public:
     std::shared_ptr<hittable> boundary;